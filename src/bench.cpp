@@ -0,0 +1,424 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// korgi_bench: measures the event-to-packet path without MIDI hardware.
+// Usage: korgi_bench [name filter]
+
+#define _CRT_SECURE_NO_WARNINGS
+#define NOMINMAX
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#pragma comment(lib, "ws2_32")
+#else
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+
+#include "config.h"
+#include "dispatch.h"
+#include "logger.h"
+#include "midi_parser.h"
+#include "pipeline.h"
+
+using namespace std;
+
+#define BENCH_EVENT_COUNT 4096
+#define BENCH_MIN_DURATION chrono::milliseconds(500)
+
+static const char* g_filter = nullptr;
+
+// Runs 'body', which handles 'eventsPerCall' events, until the minimum duration has passed
+template <typename Body>
+static void Bench(const char* name, uint64_t eventsPerCall, Body body)
+{
+	if (g_filter && !strstr(name, g_filter))
+		return;
+
+	body(); // warm up
+
+	uint64_t calls = 0;
+	clock_t cpuStart = clock();
+	Clock::time_point start = Clock::now();
+	Clock::time_point end;
+	do
+	{
+		body();
+		calls++;
+		end = Clock::now();
+	} while (end - start < BENCH_MIN_DURATION);
+
+	// CPU time of the whole process, including the loopback sink and any kernel threads working for it
+	double events = double(calls * eventsPerCall);
+	double ns = double(ToNanoseconds(end - start)) / events;
+	double cpuNs = double(clock() - cpuStart) * (1e9 / CLOCKS_PER_SEC) / events;
+	printf("%-44s %14.0f %12.1f %14.0f %12.1f\n", name, events, ns, 1e9 / ns, cpuNs);
+	fflush(stdout);
+}
+
+// Random mix of events on the mapped knob channels 0-15 and button channels 32-39
+static vector<pair<unsigned char, unsigned char>> MakeEvents()
+{
+	vector<pair<unsigned char, unsigned char>> events(BENCH_EVENT_COUNT);
+	uint32_t seed = 12345;
+	for (auto& event : events)
+	{
+		seed = seed * 1664525 + 1013904223;
+		int channel = (seed >> 8) % 20;
+		event.first = (unsigned char)(channel < 16 ? channel : 32 + channel - 16);
+		event.second = (unsigned char)((seed >> 16) & 0x7f);
+	}
+	return events;
+}
+
+static KorgiConfig MakeConfig(int port, int targetCount)
+{
+	KorgiConfig config;
+	config.password = "benchmark";
+	config.log_mode = LogMode::Quiet;
+
+	for (int target = 0; target < targetCount; target++)
+	{
+		TargetConfig address;
+		address.port = port;
+		config.targets.push_back(address);
+	}
+
+	for (int channel = 0; channel < 16; channel++)
+	{
+		KnobMapping knob;
+		knob.name = "bench_variable_" + to_string(channel);
+		knob.min_value = -100.f;
+		knob.max_value = 100.f;
+		config.devices[0].knobs[channel] = knob;
+	}
+
+	for (int channel = 32; channel < 40; channel++)
+		config.devices[0].buttons[channel] = "bench_command " + to_string(channel);
+
+	return config;
+}
+
+static bool WriteLargeConfig(const string& fileName, int lineCount)
+{
+	FILE* file = fopen(fileName.c_str(), "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "connect 127.0.0.1 27910\npassword \"bench password\"\ndevice_map nanoKONTROL2\n");
+	for (int line = 0; line < lineCount; line++)
+	{
+		switch (line % 4)
+		{
+		case 0: fprintf(file, "knob kn%d sun_azimuth_%d 0 360 rate 60 # comment\n", line % 8, line); break;
+		case 1: fprintf(file, "slider %d sun_elevation_%d -90 90\n", line % 8, line); break;
+		case 2: fprintf(file, "button S%d physical_sky %d\n", line % 8, line); break;
+		case 3: fprintf(file, "button %d \"echo line %d\"\n", 64 + line % 8, line); break;
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+// Receives and counts datagrams on a loopback port
+class UdpSink
+{
+public:
+	bool Open()
+	{
+		m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t length = sizeof(address);
+		if (bind(m_socket, (sockaddr*)&address, sizeof(address)) || getsockname(m_socket, (sockaddr*)&address, &length))
+			return false;
+
+		m_port = ntohs(address.sin_port);
+
+#ifdef _WIN32
+		DWORD timeout = 100;
+#else
+		timeval timeout = { 0, 100000 };
+#endif
+		setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+		m_thread = thread([this]() {
+			char buffer[2048];
+			while (!m_stop)
+			{
+				if (recv(m_socket, buffer, sizeof(buffer), 0) > 0)
+					m_received++;
+			}
+		});
+
+		return true;
+	}
+
+	void Close()
+	{
+		m_stop = true;
+		m_thread.join();
+#ifdef _WIN32
+		closesocket(m_socket);
+#else
+		close(m_socket);
+#endif
+	}
+
+	int Port() const { return m_port; }
+	uint64_t Received() const { return m_received; }
+
+private:
+#ifdef _WIN32
+	SOCKET m_socket = 0;
+#else
+	int m_socket = -1;
+#endif
+	int m_port = 0;
+	atomic<bool> m_stop = { false };
+	atomic<uint64_t> m_received = { 0 };
+	thread m_thread;
+};
+
+// Sends the events to one target and to eight, 'prefix' names the send path in the results
+static bool BenchSends(const string& prefix, int port, const vector<pair<unsigned char, unsigned char>>& events)
+{
+	g_config = MakeConfig(port, 1);
+	g_dispatch.reset(new DispatchTable());
+	if (!CompileDispatchTable(g_config, *g_dispatch))
+		return false;
+
+	Bench((prefix + ": packet per event").c_str(), events.size(), [&]() {
+		for (const auto& event : events)
+			HandleMidiInput(0, event.first, event.second);
+	});
+
+	Bench((prefix + ": batches of 16 events").c_str(), events.size(), [&]() {
+		for (size_t first = 0; first < events.size(); first += 16)
+		{
+			BeginBatch();
+			for (size_t event = first; event < first + 16; event++)
+				HandleMidiInput(0, events[event].first, events[event].second);
+			EndBatch();
+		}
+	});
+
+	g_config = MakeConfig(port, 8);
+	g_dispatch.reset(new DispatchTable());
+	if (!CompileDispatchTable(g_config, *g_dispatch))
+		return false;
+
+	Bench((prefix + ": packet per event, 8 targets").c_str(), events.size(), [&]() {
+		for (const auto& event : events)
+			HandleMidiInput(0, event.first, event.second);
+	});
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1)
+		g_filter = argv[1];
+
+	SetLogMode(LogMode::Quiet, 0.f);
+
+	if (!OpenSocket())
+		return 1;
+
+	UdpSink sink;
+	if (!sink.Open())
+	{
+		fprintf(stderr, "error: failed to open the loopback sink\n");
+		return 1;
+	}
+
+	printf("%-44s %14s %12s %14s %12s\n", "benchmark", "events", "ns/event", "events/s", "cpu ns/event");
+
+	// config parsing, one event is one line
+	{
+		const int lineCount = 10000;
+		string fileName = "korgi_bench.conf";
+		if (!WriteLargeConfig(fileName, lineCount))
+		{
+			fprintf(stderr, "error: couldn't write %s\n", fileName.c_str());
+			return 1;
+		}
+
+		Bench("config: parse (per line)", lineCount, [&]() {
+			KorgiConfig config;
+			ParseConfigFile(fileName, config);
+		});
+
+		KorgiConfig config;
+		ParseConfigFile(fileName, config);
+		remove(fileName.c_str());
+
+		Bench("config: compile (per channel)", config.devices[0].knobs.size() + config.devices[0].buttons.size(), [&]() {
+			DispatchTable table;
+			CompileDispatchTable(config, table);
+		});
+	}
+
+	vector<pair<unsigned char, unsigned char>> events = MakeEvents();
+
+	g_config = MakeConfig(sink.Port(), 1);
+	g_dispatch.reset(new DispatchTable());
+	if (!CompileDispatchTable(g_config, *g_dispatch))
+		return 1;
+
+	{
+		volatile float sink_value = 0.f;
+
+		Bench("dispatch: lookup and scale", events.size(), [&]() {
+			float sum = 0.f;
+			for (const auto& event : events)
+			{
+				const ChannelAction& action = g_dispatch->channels[event.first];
+				if (action.type == ChannelAction::Type::Knob)
+					sum += GetKnobValue(action, event.second);
+			}
+			sink_value = sum;
+		});
+
+		// the byte stream of a raw MIDI input, with running status as controllers send it
+		vector<uint8_t> midiBytes;
+		for (const auto& event : events)
+		{
+			if (midiBytes.empty())
+				midiBytes.push_back(0xb0);
+			midiBytes.push_back(event.first);
+			midiBytes.push_back(event.second);
+		}
+
+		Bench("input: raw MIDI parse", events.size(), [&]() {
+			MidiParser parser;
+			MidiMessage message;
+			unsigned char channel = 0, value = 0;
+			float sum = 0.f;
+			for (uint8_t byte : midiBytes)
+			{
+				if (parser.Parse(byte, message) && GetMidiControl(message, channel, value))
+					sum += value;
+			}
+			sink_value = sum;
+		});
+
+		// what every event used to cost before packets were rendered at load time
+		Bench("format: snprintf per event", events.size(), [&]() {
+			char command[256];
+			char message[MAX_RCON_MESSAGE];
+			size_t total = 0;
+			for (const auto& event : events)
+			{
+				const ChannelAction& action = g_dispatch->channels[event.first];
+				if (action.type != ChannelAction::Type::Knob)
+					continue;
+				snprintf(command, sizeof(command), "%s %.3f", action.command, GetKnobValue(action, event.second));
+				total += snprintf(message, sizeof(message), "\xff\xff\xff\xffrcon %s %s", g_config.password.c_str(), command);
+			}
+			sink_value = float(total);
+		});
+
+		Bench("format: packet cache", events.size(), [&]() {
+			const PacketSet& packets = g_dispatch->packet_sets[0];
+			char message[MAX_RCON_MESSAGE];
+			size_t total = 0;
+			for (const auto& event : events)
+			{
+				const ChannelAction& action = g_dispatch->channels[event.first];
+				if (action.type != ChannelAction::Type::Knob)
+					continue;
+				const PacketRef& packet = packets.packets[action.first_packet + event.second];
+				memcpy(message, &packets.arena[packet.offset], packet.length);
+				total += packet.length;
+			}
+			sink_value = float(total);
+		});
+	}
+
+	// handoff between the reader and sender threads of the pipelined mode, the thread is
+	// started once per call, which is amortized over many events
+	{
+		static SpscQueue<MidiInputRecord, 1024> queue;
+		const uint64_t recordCount = 64 * BENCH_EVENT_COUNT;
+
+		Bench("pipeline: queue handoff", recordCount, [&]() {
+			thread producer([&]() {
+				MidiInputRecord record = {};
+				for (uint64_t index = 0; index < recordCount; index++)
+				{
+					record.value = (unsigned char)(index & 0x7f);
+					while (!queue.Push(record))
+						this_thread::yield();
+				}
+			});
+
+			MidiInputRecord record;
+			for (uint64_t index = 0; index < recordCount; )
+			{
+				if (queue.Pop(record))
+					index++;
+				else
+					this_thread::yield();
+			}
+
+			producer.join();
+		});
+	}
+
+	uint64_t received = sink.Received();
+
+	if (!BenchSends("send", sink.Port(), events))
+		return 1;
+
+#ifndef _WIN32
+	// the same sends through io_uring, where the kernel allows it
+	if (OpenUringTransport(256))
+	{
+		bool success = BenchSends("send io_uring", sink.Port(), events);
+		CloseUringTransport();
+		if (!success)
+			return 1;
+	}
+#endif
+
+	this_thread::sleep_for(chrono::milliseconds(200));
+	printf("loopback sink received %llu datagrams\n", (unsigned long long)(sink.Received() - received));
+
+	sink.Close();
+	CloseSocket();
+
+	return 0;
+}
@@ -0,0 +1,156 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Binary control protocol, an alternative to rcon text commands for receivers that know korgi.
+// A datagram is a 16-byte header followed by up to BINARY_MAX_RECORDS 8-byte records:
+//
+//   header: uint32 magic "KRGB", uint16 version, uint16 record count,
+//           uint32 session token, uint32 sequence number
+//   record: uint16 control (device * 128 + MIDI channel), uint8 type, uint8 reserved,
+//           float32 value (the scaled knob value, or 1 for a button press)
+//
+// All fields are little-endian. The token is the FNV-1a hash of the target's password, which
+// lets the receiver drop foreign datagrams without the password being sent in the clear; it is
+// not a cryptographic authentication. The sequence number increases by one per datagram
+// sent to a target, so the receiver can detect loss and reordering.
+
+#define BINARY_MAGIC 0x4247524b // "KRGB"
+#define BINARY_VERSION 1
+#define BINARY_MAX_DATAGRAM 1024
+
+enum class BinaryRecordType : uint8_t
+{
+	Knob = 1,
+	Button = 2,
+};
+
+struct BinaryHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t count;
+	uint32_t token;
+	uint32_t sequence;
+};
+
+struct BinaryRecord
+{
+	uint16_t control;
+	BinaryRecordType type;
+	uint8_t reserved;
+	float value;
+};
+
+static_assert(sizeof(BinaryHeader) == 16, "BinaryHeader must match the wire format");
+static_assert(sizeof(BinaryRecord) == 8, "BinaryRecord must match the wire format");
+
+#define BINARY_MAX_RECORDS int((BINARY_MAX_DATAGRAM - sizeof(BinaryHeader)) / sizeof(BinaryRecord))
+
+inline uint32_t GetBinaryToken(const char* password)
+{
+	uint32_t hash = 2166136261u;
+	for (const char* c = password; *c; c++)
+		hash = (hash ^ uint8_t(*c)) * 16777619u;
+	return hash;
+}
+
+// The fields are stored byte by byte, so the wire format is little-endian on any host
+inline void StoreLittleEndian(char* out, uint32_t value, int size)
+{
+	for (int byte = 0; byte < size; byte++)
+		out[byte] = char(value >> (8 * byte));
+}
+
+inline uint32_t LoadLittleEndian(const char* in, int size)
+{
+	uint32_t value = 0;
+	for (int byte = 0; byte < size; byte++)
+		value |= uint32_t(uint8_t(in[byte])) << (8 * byte);
+	return value;
+}
+
+inline void EncodeBinaryHeader(const BinaryHeader& header, char* out)
+{
+	StoreLittleEndian(out + offsetof(BinaryHeader, magic), header.magic, 4);
+	StoreLittleEndian(out + offsetof(BinaryHeader, version), header.version, 2);
+	StoreLittleEndian(out + offsetof(BinaryHeader, count), header.count, 2);
+	StoreLittleEndian(out + offsetof(BinaryHeader, token), header.token, 4);
+	StoreLittleEndian(out + offsetof(BinaryHeader, sequence), header.sequence, 4);
+}
+
+inline void EncodeBinaryRecord(const BinaryRecord& record, char* out)
+{
+	uint32_t value;
+	memcpy(&value, &record.value, sizeof(value));
+
+	StoreLittleEndian(out + offsetof(BinaryRecord, control), record.control, 2);
+	out[offsetof(BinaryRecord, type)] = char(record.type);
+	out[offsetof(BinaryRecord, reserved)] = 0;
+	StoreLittleEndian(out + offsetof(BinaryRecord, value), value, 4);
+}
+
+inline BinaryRecord DecodeBinaryRecord(const char* data)
+{
+	BinaryRecord record;
+	record.control = uint16_t(LoadLittleEndian(data + offsetof(BinaryRecord, control), 2));
+	record.type = BinaryRecordType(data[offsetof(BinaryRecord, type)]);
+	record.reserved = uint8_t(data[offsetof(BinaryRecord, reserved)]);
+
+	uint32_t value = LoadLittleEndian(data + offsetof(BinaryRecord, value), 4);
+	memcpy(&record.value, &value, sizeof(value));
+	return record;
+}
+
+// Sets the record count and sequence number of a datagram that starts with a header
+inline void StampBinaryHeader(char* datagram, uint16_t count, uint32_t sequence)
+{
+	StoreLittleEndian(datagram + offsetof(BinaryHeader, count), count, 2);
+	StoreLittleEndian(datagram + offsetof(BinaryHeader, sequence), sequence, 4);
+}
+
+// Validates a received datagram and returns its records, or nullptr if it isn't a valid
+// datagram with the expected token. Decode the records with DecodeBinaryRecord().
+inline const char* DecodeBinaryDatagram(const char* data, int length, uint32_t token, BinaryHeader& header)
+{
+	if (length < int(sizeof(BinaryHeader)))
+		return nullptr;
+
+	header.magic = LoadLittleEndian(data + offsetof(BinaryHeader, magic), 4);
+	header.version = uint16_t(LoadLittleEndian(data + offsetof(BinaryHeader, version), 2));
+	header.count = uint16_t(LoadLittleEndian(data + offsetof(BinaryHeader, count), 2));
+	header.token = LoadLittleEndian(data + offsetof(BinaryHeader, token), 4);
+	header.sequence = LoadLittleEndian(data + offsetof(BinaryHeader, sequence), 4);
+
+	if (header.magic != BINARY_MAGIC || header.version != BINARY_VERSION || header.token != token)
+		return nullptr;
+
+	if (length != int(sizeof(BinaryHeader) + header.count * sizeof(BinaryRecord)))
+		return nullptr;
+
+	return data + sizeof(BinaryHeader);
+}
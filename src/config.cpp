@@ -0,0 +1,809 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+
+#include "control_surface_map.h"
+#include "dispatch.h"
+
+using namespace std;
+
+KorgiConfig g_config;
+std::string g_configFileName;
+
+char* tokenize(char* str, const char* delimiters)
+{
+	static char* next = NULL;
+	if (str) next = str;
+
+	while (*next)
+	{
+		if (!strchr(delimiters, *next))
+			break;
+
+		next++;
+	}
+
+	if (!*next)
+		return NULL;
+
+	if (*next == '"')
+	{
+		next++;
+		delimiters = "\"";
+	}
+
+	char* start = next;
+
+	while (*next)
+	{
+		if(strchr(delimiters, *next))
+		{
+			*next = 0;
+			next++;
+			break;
+		}
+
+		next++;
+	}
+
+	return start;
+}
+
+bool ParseConfigFile(const std::string& fileName, KorgiConfig& new_config)
+{
+	// targets and devices are not inherited from the previous config, they are listed again on every load
+	new_config.targets.clear();
+	new_config.devices.assign(1, DeviceConfig());
+	new_config.banks.clear();
+
+	// directives before the first 'midi_device' section apply to the first device
+	bool deviceConfigured = false;
+
+	// index of the bank that the current section maps controls in, -1 outside of 'bank' sections
+	int bank = -1;
+
+	FILE* file = fopen(fileName.c_str(), "r");
+	if (!file)
+	{
+		fprintf(stderr, "error: couldn't open %s\n", fileName.c_str());
+		return false;
+	}
+
+	bool success = true;
+	char linebuf[256];
+	int lineno = 0;
+	while (fgets(linebuf, sizeof(linebuf), file))
+	{
+		lineno++;
+
+		{ char* t = strchr(linebuf, '#'); if (t) *t = 0; } // remove comments
+		{ char* t = strchr(linebuf, '\n'); if (t) *t = 0; } // remove newline
+
+		const char* delimiters = " \t\r\n";
+		char* command = tokenize(linebuf, delimiters);
+
+		if (!command)
+			continue;
+
+		if (strcmp(command, "connect") == 0 || strcmp(command, "output") == 0)
+		{
+			// 'connect' is short for 'output rcon'
+			char* format = strcmp(command, "output") == 0 ? tokenize(nullptr, delimiters) : nullptr;
+			char* addr = tokenize(nullptr, delimiters);
+			char* port = tokenize(nullptr, delimiters);
+			char* password = tokenize(nullptr, delimiters);
+
+			if (!addr)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for '%s'\n", fileName.c_str(), lineno, command);
+				success = false;
+				continue;
+			}
+
+			TargetConfig target;
+			if (format && strcmp(format, "binary") == 0)
+				target.format = OutputFormat::Binary;
+			else if (format && strcmp(format, "osc") == 0)
+				target.format = OutputFormat::Osc;
+			else if (format && strcmp(format, "file") == 0)
+				target.format = OutputFormat::Text;
+			else if (format && strcmp(format, "rcon") != 0)
+			{
+				fprintf(stderr, "%s:%d: unknown output format '%s'\n", fileName.c_str(), lineno, format);
+				success = false;
+				continue;
+			}
+
+			target.address = addr;
+			if (port) target.port = atoi(port);
+			if (password) target.password = password;
+			new_config.targets.push_back(target);
+		}
+		else if (strcmp(command, "password") == 0)
+		{
+			char* password = tokenize(nullptr, delimiters);
+
+			if (!password)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'password'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.password = password;
+		}
+		else if (strcmp(command, "device") == 0)
+		{
+			char* device = tokenize(nullptr, delimiters);
+
+			if (!device)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'device'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.devices.back().device = atoi(device);
+			deviceConfigured = true;
+		}
+		else if (strcmp(command, "device_name") == 0)
+		{
+			char* device_name = tokenize(nullptr, delimiters);
+			char* port = tokenize(nullptr, delimiters);
+
+			if (!device_name)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'device_name'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.devices.back().device_name = device_name;
+			if (port) new_config.devices.back().port = atoi(port);
+			deviceConfigured = true;
+		}
+		else if (strcmp(command, "raw_midi") == 0)
+		{
+			char* raw_midi = tokenize(nullptr, delimiters);
+
+			if (!raw_midi)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'raw_midi'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.devices.back().raw_midi = raw_midi;
+			deviceConfigured = true;
+		}
+		else if (strcmp(command, "midi_device") == 0)
+		{
+			char* device_name = tokenize(nullptr, delimiters);
+			char* port = tokenize(nullptr, delimiters);
+
+			if (!device_name)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'midi_device'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			if (deviceConfigured)
+			{
+				if (new_config.devices.size() >= MAX_MIDI_DEVICES)
+				{
+					fprintf(stderr, "%s:%d: too many MIDI devices, at most %d are supported\n", fileName.c_str(), lineno, MAX_MIDI_DEVICES);
+					success = false;
+					continue;
+				}
+
+				new_config.devices.emplace_back();
+			}
+
+			DeviceConfig& device = new_config.devices.back();
+			device.device_name = device_name;
+			if (port) device.port = atoi(port);
+			deviceConfigured = true;
+			bank = -1;
+
+			// WinMM devices are identified by number
+			char* endptr = nullptr;
+			int id = strtol(device_name, &endptr, 10);
+			if (!*endptr) device.device = id;
+		}
+		else if (strcmp(command, "rate") == 0)
+		{
+			char* rate = tokenize(nullptr, delimiters);
+
+			if (!rate)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'rate'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.rate = max(0.f, float(atof(rate)));
+		}
+		else if (strcmp(command, "resync") == 0)
+		{
+			char* interval = tokenize(nullptr, delimiters);
+			char* idle = tokenize(nullptr, delimiters);
+
+			if (!interval)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'resync'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.resync_interval = max(0.f, float(atof(interval)));
+			new_config.resync_idle = idle ? max(0.f, float(atof(idle))) : 0.f;
+		}
+		else if (strcmp(command, "smoothing_rate") == 0)
+		{
+			char* rate = tokenize(nullptr, delimiters);
+
+			if (!rate || atof(rate) <= 0.0)
+			{
+				fprintf(stderr, "%s:%d: 'smoothing_rate' expects a positive number\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.smoothing_rate = float(atof(rate));
+		}
+		else if (strcmp(command, "deadband") == 0)
+		{
+			char* deadband = tokenize(nullptr, delimiters);
+
+			if (!deadband)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'deadband'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.deadband = max(0, atoi(deadband));
+		}
+		else if (strcmp(command, "log") == 0)
+		{
+			char* mode = tokenize(nullptr, delimiters);
+			char* rate = tokenize(nullptr, delimiters);
+
+			if (!mode)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'log'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			if (strcmp(mode, "quiet") == 0)
+				new_config.log_mode = LogMode::Quiet;
+			else if (strcmp(mode, "status") == 0)
+				new_config.log_mode = LogMode::Status;
+			else if (strcmp(mode, "full") == 0)
+				new_config.log_mode = LogMode::Full;
+			else
+			{
+				fprintf(stderr, "%s:%d: unknown log mode '%s'\n", fileName.c_str(), lineno, mode);
+				success = false;
+				continue;
+			}
+
+			if (rate) new_config.log_rate = float(atof(rate));
+		}
+		else if (strcmp(command, "record") == 0)
+		{
+			char* file = tokenize(nullptr, delimiters);
+
+			if (!file)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'record'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.record_file = file;
+		}
+		else if (strcmp(command, "replay") == 0)
+		{
+			char* file = tokenize(nullptr, delimiters);
+			char* speed = tokenize(nullptr, delimiters);
+
+			if (!file)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'replay'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.replay_file = file;
+			new_config.replay_speed = 1.f;
+
+			if (speed)
+			{
+				if (strcmp(speed, "fast") == 0)
+					new_config.replay_speed = 0.f;
+				else
+					new_config.replay_speed = max(0.f, float(atof(speed)));
+			}
+		}
+		else if (strcmp(command, "pipeline") == 0)
+		{
+			char* mode = tokenize(nullptr, delimiters);
+
+			if (!mode)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'pipeline'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			if (strcmp(mode, "off") == 0)
+				new_config.pipeline = PipelineMode::Off;
+			else if (strcmp(mode, "on") == 0)
+				new_config.pipeline = PipelineMode::On;
+			else if (strcmp(mode, "busy") == 0)
+				new_config.pipeline = PipelineMode::Busy;
+			else
+			{
+				fprintf(stderr, "%s:%d: unknown pipeline mode '%s'\n", fileName.c_str(), lineno, mode);
+				success = false;
+				continue;
+			}
+		}
+		else if (strcmp(command, "io_uring") == 0)
+		{
+			char* mode = tokenize(nullptr, delimiters);
+			char* buffers = tokenize(nullptr, delimiters);
+
+			if (!mode || (strcmp(mode, "on") != 0 && strcmp(mode, "off") != 0))
+			{
+				fprintf(stderr, "%s:%d: 'io_uring' expects 'on' or 'off'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			if (buffers && (atoi(buffers) < 1 || atoi(buffers) > 4096))
+			{
+				fprintf(stderr, "%s:%d: the number of io_uring buffers must be between 1 and 4096\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.io_uring = strcmp(mode, "on") == 0;
+			if (buffers) new_config.io_uring_buffers = atoi(buffers);
+		}
+		else if (strcmp(command, "metrics") == 0)
+		{
+			char* address = tokenize(nullptr, delimiters);
+			char* port = tokenize(nullptr, delimiters);
+			bool off = address && strcmp(address, "off") == 0;
+
+			if (!off && (!address || !port))
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'metrics'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			bool unixSocket = !off && strcmp(address, "unix") == 0;
+
+			// the counters are for local scrapers, they aren't exposed on other interfaces
+			if (!off && !unixSocket && strcmp(address, "localhost") != 0 && strncmp(address, "127.", 4) != 0)
+			{
+				fprintf(stderr, "%s:%d: the metrics address must be a loopback address such as 127.0.0.1\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			if (!off && !unixSocket && (atoi(port) < 1 || atoi(port) > 65535))
+			{
+				fprintf(stderr, "%s:%d: invalid metrics port '%s'\n", fileName.c_str(), lineno, port);
+				success = false;
+				continue;
+			}
+
+			// 'metrics unix <path>' listens on a Unix socket instead of a TCP port
+			new_config.metrics_address = off ? "" : unixSocket ? port : strcmp(address, "localhost") == 0 ? "127.0.0.1" : address;
+			new_config.metrics_port = off || unixSocket ? 0 : atoi(port);
+		}
+		else if (strcmp(command, "flight_recorder") == 0)
+		{
+			char* file = tokenize(nullptr, delimiters);
+			char* records = tokenize(nullptr, delimiters);
+
+			if (!file)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'flight_recorder'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			if (records && (atoi(records) < 16 || atoi(records) > 16 * 1024 * 1024))
+			{
+				fprintf(stderr, "%s:%d: the number of flight recorder records must be between 16 and 16777216\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.flight_recorder_file = strcmp(file, "off") == 0 ? "" : file;
+			if (records) new_config.flight_recorder_records = atoi(records);
+		}
+		else if (strcmp(command, "thread") == 0)
+		{
+			char* name = tokenize(nullptr, delimiters);
+
+			if (!name)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'thread'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			if (strcmp(name, "reader") != 0 && strcmp(name, "sender") != 0)
+			{
+				fprintf(stderr, "%s:%d: unknown thread '%s'\n", fileName.c_str(), lineno, name);
+				success = false;
+				continue;
+			}
+
+			// settings follow as <name> <value> pairs, like the options of knobs
+			ThreadConfig thread;
+			bool optionsValid = true;
+			while (char* option = tokenize(nullptr, delimiters))
+			{
+				char* value = tokenize(nullptr, delimiters);
+
+				if (!value)
+				{
+					fprintf(stderr, "%s:%d: missing value for thread option '%s'\n", fileName.c_str(), lineno, option);
+					optionsValid = false;
+					break;
+				}
+
+				if (strcmp(option, "priority") == 0 && atoi(value) >= 0 && atoi(value) <= 99)
+				{
+					thread.priority = atoi(value);
+				}
+				else if (strcmp(option, "cpu") == 0 && atoi(value) >= 0)
+				{
+					thread.cpu = atoi(value);
+				}
+				else
+				{
+					fprintf(stderr, "%s:%d: invalid thread option '%s %s'\n", fileName.c_str(), lineno, option, value);
+					optionsValid = false;
+					break;
+				}
+			}
+
+			if (!optionsValid)
+			{
+				success = false;
+				continue;
+			}
+
+			if (strcmp(name, "reader") == 0)
+				new_config.reader_thread = thread;
+			else
+				new_config.sender_thread = thread;
+		}
+		else if (strcmp(command, "trace") == 0)
+		{
+			char* mode = tokenize(nullptr, delimiters);
+
+			if (!mode || (strcmp(mode, "on") != 0 && strcmp(mode, "off") != 0))
+			{
+				fprintf(stderr, "%s:%d: 'trace' expects 'on' or 'off'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			new_config.trace = strcmp(mode, "on") == 0;
+		}
+		else if (strcmp(command, "device_definition") == 0)
+		{
+			char* file = tokenize(nullptr, delimiters);
+
+			if (!file)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'device_definition'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			if (!loadControlSurfaceDefinition(file, new_config.device_definitions))
+			{
+				success = false;
+				continue;
+			}
+		}
+		else if (strcmp(command, "device_map") == 0)
+		{
+			char* device_map = tokenize(nullptr, delimiters);
+
+			if (!device_map)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'device_map'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			if (!isControlSurfaceType(device_map, new_config.device_definitions))
+			{
+				fprintf(stderr, "%s:%d: unsupported control surface type '%s'\n", fileName.c_str(), lineno, device_map);
+				success = false;
+				continue;
+			}
+
+			new_config.devices.back().device_map = device_map;
+			deviceConfigured = true;
+		}
+		else if (strcmp(command, "bank") == 0)
+		{
+			char* name = tokenize(nullptr, delimiters);
+
+			if (!name)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for 'bank'\n", fileName.c_str(), lineno);
+				success = false;
+				continue;
+			}
+
+			if (strcmp(name, "next") == 0 || strcmp(name, "previous") == 0)
+			{
+				fprintf(stderr, "%s:%d: '%s' is reserved and can't be used as a bank name\n", fileName.c_str(), lineno, name);
+				success = false;
+				continue;
+			}
+
+			bank = int(find(new_config.banks.begin(), new_config.banks.end(), name) - new_config.banks.begin());
+			if (bank == int(new_config.banks.size()))
+				new_config.banks.push_back(name);
+
+			DeviceConfig& device = new_config.devices.back();
+			if (int(device.banks.size()) <= bank)
+				device.banks.resize(bank + 1);
+			deviceConfigured = true;
+		}
+		else if (strcmp(command, "button") == 0 || strcmp(command, "bank_button") == 0)
+		{
+			bool isBankButton = strcmp(command, "bank_button") == 0;
+
+			char* channel = tokenize(nullptr, delimiters);
+			char* command = isBankButton ? tokenize(nullptr, delimiters) : channel + strlen(channel) + 1;
+
+			if (!channel || !command || !*command)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for '%s'\n", fileName.c_str(), lineno, isBankButton ? "bank_button" : "button");
+				success = false;
+				continue;
+			}
+
+			DeviceConfig& device = new_config.devices.back();
+			deviceConfigured = true;
+
+			// bank buttons select banks in every bank, so they don't belong to the section
+			unordered_map<int, string>& buttons = isBankButton ? device.bank_buttons : bank < 0 ? device.buttons : device.banks[bank].buttons;
+
+			char *endptr = nullptr;
+			int c = strtol(channel, &endptr, 10);
+			if (endptr - channel != strlen(channel))
+			{
+				// invalid integer, try control surface alias
+				ControlSurface surf;
+				if (!mapControl(surf, device.device_map.c_str(), channel, new_config.device_definitions))
+				{
+					fprintf(stderr, "%s:%d: invalid channel number or button alias '%s'\n", fileName.c_str(), lineno, channel);
+					success = false;
+					continue;
+				}
+
+				if (surf.type != ControlSurface::Type::Button)
+				{
+					fprintf(stderr, "%s:%d: control surface '%s' is not a button\n", fileName.c_str(), lineno, channel);
+					success = false;
+					continue;
+				}
+
+				buttons[surf.channel] = command;
+			} else {
+				buttons[c] = command;
+			}
+		}
+		else if (strcmp(command, "knob") == 0 || strcmp(command, "slider") == 0)
+		{
+			bool isKnob = strcmp(command, "knob") == 0;
+
+			char* channel = tokenize(nullptr, delimiters);
+			char* cvar = tokenize(nullptr, delimiters);
+			char* vmin = tokenize(nullptr, delimiters);
+			char* vmax = tokenize(nullptr, delimiters);
+
+			if (!channel || !cvar || !vmin || !vmax)
+			{
+				fprintf(stderr, "%s:%d: insufficient parameters for '%s'\n", fileName.c_str(), lineno, command);
+				success = false;
+				continue;
+			}
+
+			KnobMapping mapping;
+			mapping.name = cvar;
+			mapping.min_value = float(atof(vmin));
+			mapping.max_value = float(atof(vmax));
+
+			// optional per-control settings follow as <name> <value> pairs
+			bool optionsValid = true;
+			while (char* option = tokenize(nullptr, delimiters))
+			{
+				char* value = tokenize(nullptr, delimiters);
+
+				if (!value)
+				{
+					fprintf(stderr, "%s:%d: missing value for %s option '%s'\n", fileName.c_str(), lineno, command, option);
+					optionsValid = false;
+					break;
+				}
+
+				if (strcmp(option, "rate") == 0)
+				{
+					mapping.rate = max(0.f, float(atof(value)));
+				}
+				else if (strcmp(option, "deadband") == 0)
+				{
+					mapping.deadband = max(0, atoi(value));
+				}
+				else if (strcmp(option, "smooth") == 0)
+				{
+					mapping.smoothing = max(0.f, float(atof(value)));
+				}
+				else
+				{
+					fprintf(stderr, "%s:%d: unknown %s option '%s'\n", fileName.c_str(), lineno, command, option);
+					optionsValid = false;
+					break;
+				}
+			}
+
+			if (!optionsValid)
+			{
+				success = false;
+				continue;
+			}
+
+			DeviceConfig& device = new_config.devices.back();
+			deviceConfigured = true;
+
+			unordered_map<int, KnobMapping>& knobs = bank < 0 ? device.knobs : device.banks[bank].knobs;
+
+			char *endptr = nullptr;
+			int c = strtol(channel, &endptr, 10);
+			if (endptr - channel != strlen(channel))
+			{
+				// invalid integer, try control surface alias
+				ControlSurface surf;
+				if (!mapControl(surf, device.device_map.c_str(), channel, new_config.device_definitions))
+				{
+					fprintf(stderr, "%s:%d: invalid channel number or %s alias '%s'\n", fileName.c_str(), lineno, command, channel);
+					success = false;
+					continue;
+				}
+
+				if ((isKnob && surf.type != ControlSurface::Type::RotaryKnob) ||
+					(!isKnob && surf.type != ControlSurface::Type::Slider))
+				{
+					fprintf(stderr, "%s:%d: control surface '%s' is not a %s\n", fileName.c_str(), lineno, channel, command);
+					success = false;
+					continue;
+				}
+
+				knobs[surf.channel] = mapping;
+			} else {
+				knobs[c] = mapping;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "%s:%d: unknown directive '%s'\n", fileName.c_str(), lineno, command);
+			success = false;
+			continue;
+		}
+	}
+
+	fclose(file);
+
+	if (new_config.targets.empty())
+		new_config.targets.push_back(TargetConfig());
+
+	for (const TargetConfig& target : new_config.targets)
+	{
+		bool needsPassword = target.format == OutputFormat::Rcon || target.format == OutputFormat::Binary;
+		if (needsPassword && target.password.empty() && new_config.password.empty())
+		{
+			fprintf(stderr, "%s: password not specified for %s:%d\n", fileName.c_str(), target.address.c_str(), target.port);
+			success = false;
+		}
+	}
+
+	for (const DeviceConfig& device : new_config.devices)
+	{
+		for (const auto& button : device.bank_buttons)
+		{
+			const string& name = button.second;
+			if (name != "next" && name != "previous" && find(new_config.banks.begin(), new_config.banks.end(), name) == new_config.banks.end())
+			{
+				fprintf(stderr, "%s: unknown bank '%s' for bank button %d\n", fileName.c_str(), name.c_str(), button.first);
+				success = false;
+			}
+		}
+	}
+
+	return success;
+}
+
+bool ReadConfigFile()
+{
+	KorgiConfig new_config = g_config;
+	bool success = ParseConfigFile(g_configFileName, new_config);
+
+	unique_ptr<DispatchTable> new_dispatch(new DispatchTable());
+	if (success && !CompileDispatchTable(new_config, *new_dispatch))
+		success = false;
+
+	if (success)
+	{
+		int knobCount = 0, buttonCount = 0;
+		for (const DeviceConfig& device : new_config.devices)
+		{
+			knobCount += int(device.knobs.size());
+			buttonCount += int(device.buttons.size() + device.bank_buttons.size());
+
+			for (const BankMappings& bank : device.banks)
+			{
+				knobCount += int(bank.knobs.size());
+				buttonCount += int(bank.buttons.size());
+			}
+		}
+
+		string banks = new_config.banks.empty() ? string() : " in " + to_string(new_config.banks.size()) + " banks";
+		if (new_config.devices.size() > 1)
+			printf("korgi: mapping %d knobs and %d buttons on %d devices%s\n", knobCount, buttonCount, int(new_config.devices.size()), banks.c_str());
+		else
+			printf("korgi: mapping %d knobs and %d buttons%s\n", knobCount, buttonCount, banks.c_str());
+		g_config = new_config;
+		g_dispatch = move(new_dispatch);
+		ResetKnobFilters();
+		SetLogMode(g_config.log_mode, g_config.log_rate);
+	}
+
+	return success;
+}
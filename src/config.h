@@ -0,0 +1,142 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "control_surface_map.h"
+#include "logger.h"
+
+// MIDI data bytes are 7-bit, so there are at most 128 distinct controls
+#define MIDI_CHANNEL_COUNT 128
+
+// MIDI devices that korgi can listen to at the same time
+#define MAX_MIDI_DEVICES 8
+
+struct KnobMapping
+{
+	std::string name;
+	float min_value;
+	float max_value;
+	float rate = -1.f; // per-control override of KorgiConfig::rate, negative if not set
+	int deadband = -1; // per-control override of KorgiConfig::deadband, negative if not set
+	float smoothing = 0.f; // time constant in seconds for interpolated updates, 0 to disable
+};
+
+// Encoders are implemented in output.cpp
+enum class OutputFormat
+{
+	Rcon,   // Q2PRO remote console commands
+	Binary, // see binary_protocol.h
+	Osc,    // Open Sound Control bundles
+	Text,   // one command per line, written to a file instead of a UDP target
+};
+
+// How MIDI input is handed to the sender, see pipeline.h
+enum class PipelineMode
+{
+	Off,  // the main loop reads and sends
+	On,   // a reader thread feeds the main loop, which sleeps while there is nothing to do
+	Busy, // like On, but the main loop spins instead of sleeping
+};
+
+// Scheduling of one of korgi's threads
+struct ThreadConfig
+{
+	int priority = 0; // SCHED_FIFO priority, 0 keeps the default scheduling
+	int cpu = -1;     // CPU to pin the thread to, -1 to let it run anywhere
+};
+
+struct TargetConfig
+{
+	OutputFormat format = OutputFormat::Rcon;
+	std::string address = "127.0.0.1"; // file name for OutputFormat::Text, "-" for stdout
+	int port = 27910;
+	std::string password; // empty to use KorgiConfig::password
+};
+
+// Controls mapped in a 'bank' section, which replace the device's other mappings of the same channels
+// while the bank is selected
+struct BankMappings
+{
+	std::unordered_map<int, std::string> buttons;
+	std::unordered_map<int, KnobMapping> knobs;
+};
+
+// A MIDI device and the controls mapped on it
+struct DeviceConfig
+{
+	int device = 0; // WinMM device ID
+	std::string device_name = "nanoKONTROL2"; // ALSA client name
+	int port = 0; // ALSA port of the client
+	std::string raw_midi; // ALSA raw MIDI device or file to read bytes from instead of the sequencer
+	std::string device_map; // control surface type for control aliases, empty if none
+	std::unordered_map<int, std::string> buttons; // mapped in all banks
+	std::unordered_map<int, KnobMapping> knobs;
+	std::vector<BankMappings> banks; // indexed like KorgiConfig::banks, may be shorter
+	std::unordered_map<int, std::string> bank_buttons; // bank to select, "next" or "previous"
+};
+
+struct KorgiConfig
+{
+	std::vector<TargetConfig> targets; // one per 'connect' directive, or the default target if there are none
+	std::vector<DeviceConfig> devices = std::vector<DeviceConfig>(1); // one per 'midi_device' section
+	std::vector<std::string> banks; // names in the order of their first 'bank' section, the first one is selected at startup
+	LoadedSurfaces device_definitions; // maps loaded by 'device_definition', kept across reloads
+	std::string password;
+	float rate = 0.f; // knob and slider updates per second, 0 sends every event
+	int deadband = 0; // MIDI steps that a knob must move against its last direction to be sent
+	float smoothing_rate = 60.f; // interpolated updates per second of knobs with smoothing
+	float resync_interval = 0.f; // seconds between snapshots of all knob values, 0 to disable
+	float resync_idle = 0.f; // seconds without knob updates before a snapshot is sent, 0 to disable
+	LogMode log_mode = LogMode::Status;
+	float log_rate = 20.f; // status line updates per second
+	bool trace = false; // record latency histograms
+	std::string record_file; // MIDI trace to write, see midi_trace.h
+	std::string replay_file; // MIDI trace to use instead of a MIDI device
+	float replay_speed = 1.f; // 0 replays as fast as possible
+	PipelineMode pipeline = PipelineMode::Off;
+	ThreadConfig reader_thread; // only exists in pipelined mode
+	ThreadConfig sender_thread; // the main loop
+	bool io_uring = false; // send UDP packets through io_uring instead of sendmmsg
+	int io_uring_buffers = 256; // packets that can be in flight at the same time
+	std::string metrics_address; // where the metrics endpoint listens, empty to disable it
+	int metrics_port = 0; // TCP port, 0 if metrics_address is the path of a Unix socket
+	std::string flight_recorder_file; // memory-mapped ring of recent records, empty to disable it
+	int flight_recorder_records = 65536;
+};
+
+extern KorgiConfig g_config;
+extern std::string g_configFileName;
+
+// Parses 'fileName' on top of 'config', which holds the previous settings.
+// Errors are reported to stderr; returns false if there were any.
+bool ParseConfigFile(const std::string& fileName, KorgiConfig& config);
+
+// Parses g_configFileName and applies it if there are no errors
+bool ReadConfigFile();
+
+// a version of strtok that supports double quotes
+char* tokenize(char* str, const char* delimiters);
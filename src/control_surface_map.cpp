@@ -20,18 +20,24 @@
 * DEALINGS IN THE SOFTWARE.
 */
 
+#define _CRT_SECURE_NO_WARNINGS
+
 #include "control_surface_map.h"
 
-#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
 #include <string>
+#include <vector>
 
 #define BUTTON(__channel) ControlSurface(ControlSurface::Type::Button, __channel)
 #define SLIDER(__channel) ControlSurface(ControlSurface::Type::Slider, __channel)
 #define KNOB(__channel) ControlSurface(ControlSurface::Type::RotaryKnob, __channel)
 
-typedef std::map<std::string, ControlSurface> ControlSurfaceMap;
+#define COUNT_OF(__array) (sizeof(__array) / sizeof((__array)[0]))
 
-static ControlSurfaceMap controlMap_Korg_nanoKONTROL2 = {
+static constexpr ControlAlias controlMap_Korg_nanoKONTROL2[] = {
     { "rewind",         BUTTON(43) },
     { "fwd",            BUTTON(44) },
     { "stop",           BUTTON(42) },
@@ -85,30 +91,213 @@ static ControlSurfaceMap controlMap_Korg_nanoKONTROL2 = {
     { "kn7",            KNOB(23) },
 };
 
-static std::map<std::string, ControlSurfaceMap*> controlSurfaces = {
-    { "nanoKONTROL2", &controlMap_Korg_nanoKONTROL2 }
+static_assert(hasUniqueNames(controlMap_Korg_nanoKONTROL2, COUNT_OF(controlMap_Korg_nanoKONTROL2)), "duplicate control name in the nanoKONTROL2 map");
+static_assert(hasValidChannels(controlMap_Korg_nanoKONTROL2, COUNT_OF(controlMap_Korg_nanoKONTROL2)), "duplicate or invalid channel in the nanoKONTROL2 map");
+
+static constexpr ControlHash controlHash_Korg_nanoKONTROL2 = makeControlHash(controlMap_Korg_nanoKONTROL2, COUNT_OF(controlMap_Korg_nanoKONTROL2));
+
+static_assert(controlHash_Korg_nanoKONTROL2.valid, "no perfect hash for the nanoKONTROL2 map");
+
+struct ControlSurfaceMap
+{
+    const char *name;
+    const ControlAlias *controls;
+    size_t count;
+    const ControlHash *hash;
+};
+
+static constexpr ControlSurfaceMap builtinSurfaces[] = {
+    { "nanoKONTROL2", controlMap_Korg_nanoKONTROL2, COUNT_OF(controlMap_Korg_nanoKONTROL2), &controlHash_Korg_nanoKONTROL2 },
+};
+
+// A map loaded from a definition file, which owns the names of its controls
+struct LoadedSurface
+{
+    std::string name;
+    std::vector<std::string> names;
+    std::vector<ControlAlias> controls;
+    ControlHash hash;
 };
 
-static ControlSurfaceMap *controlSurfaceMap = nullptr;
+static bool findSurface(ControlSurfaceMap& out, const char *name, const LoadedSurfaces& loadedSurfaces)
+{
+    for (const ControlSurfaceMap& surface : builtinSurfaces)
+    {
+        if (strcmp(surface.name, name) == 0)
+        {
+            out = surface;
+            return true;
+        }
+    }
+
+    for (const auto& surface : loadedSurfaces)
+    {
+        if (surface->name == name)
+        {
+            out = { surface->name.c_str(), surface->controls.data(), surface->controls.size(), &surface->hash };
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool isControlSurfaceType(const char *name, const LoadedSurfaces& loaded)
+{
+    ControlSurfaceMap surface;
+    return findSurface(surface, name, loaded);
+}
 
-bool setControlSurfaceType(const char *name)
+bool mapControl(ControlSurface& out, const char *surfaceType, const char *name, const LoadedSurfaces& loaded)
 {
-    if (controlSurfaces.find(name) == controlSurfaces.end())
+    ControlSurfaceMap surface;
+    if (!findSurface(surface, surfaceType, loaded))
+    {
+        return false;
+    }
+
+    uint32_t hash = hashControlName(name);
+    int index = surface.hash->slots[getControlHashSlot(hash, surface.hash->displacements[hash % CONTROL_HASH_BUCKETS])];
+    if (!index || strcmp(surface.controls[index - 1].name, name) != 0)
     {
         return false;
     }
 
-    controlSurfaceMap = controlSurfaces[name];
+    out = surface.controls[index - 1].control;
     return true;
 }
 
-bool mapControl(ControlSurface& out, const char *name)
+// The file has one directive per line, like the config file:
+//   name <device map name>
+//   button|slider|knob <control name> <channel>
+bool loadControlSurfaceDefinition(const char *fileName, LoadedSurfaces& loadedSurfaces)
 {
-    if (controlSurfaceMap->find(name) == controlSurfaceMap->end())
+    FILE* file = fopen(fileName, "r");
+    if (!file)
+    {
+        fprintf(stderr, "error: couldn't open %s\n", fileName);
+        return false;
+    }
+
+    std::shared_ptr<LoadedSurface> surface(new LoadedSurface());
+    std::vector<ControlSurface> controls;
+
+    bool success = true;
+    char linebuf[256];
+    int lineno = 0;
+    while (fgets(linebuf, sizeof(linebuf), file))
+    {
+        lineno++;
+
+        { char* t = strchr(linebuf, '#'); if (t) *t = 0; } // remove comments
+
+        const char* delimiters = " \t\r\n";
+        char* command = strtok(linebuf, delimiters);
+        char* name = command ? strtok(nullptr, delimiters) : nullptr;
+        char* channel = name ? strtok(nullptr, delimiters) : nullptr;
+
+        if (!command)
+            continue;
+
+        if (strcmp(command, "name") == 0)
+        {
+            if (!name)
+            {
+                fprintf(stderr, "%s:%d: insufficient parameters for 'name'\n", fileName, lineno);
+                success = false;
+                continue;
+            }
+
+            surface->name = name;
+            continue;
+        }
+
+        ControlSurface::Type type;
+        if (strcmp(command, "button") == 0)
+            type = ControlSurface::Type::Button;
+        else if (strcmp(command, "slider") == 0)
+            type = ControlSurface::Type::Slider;
+        else if (strcmp(command, "knob") == 0)
+            type = ControlSurface::Type::RotaryKnob;
+        else
+        {
+            fprintf(stderr, "%s:%d: unknown directive '%s'\n", fileName, lineno, command);
+            success = false;
+            continue;
+        }
+
+        if (!channel)
+        {
+            fprintf(stderr, "%s:%d: insufficient parameters for '%s'\n", fileName, lineno, command);
+            success = false;
+            continue;
+        }
+
+        char* endptr = nullptr;
+        int c = strtol(channel, &endptr, 10);
+        if (*endptr || c < 0 || c >= 128)
+        {
+            fprintf(stderr, "%s:%d: invalid channel number '%s'\n", fileName, lineno, channel);
+            success = false;
+            continue;
+        }
+
+        surface->names.push_back(name);
+        controls.push_back(ControlSurface(type, c));
+    }
+
+    fclose(file);
+
+    if (!success)
+        return false;
+
+    if (surface->name.empty())
+    {
+        fprintf(stderr, "%s: device map name not specified\n", fileName);
+        return false;
+    }
+
+    for (const ControlSurfaceMap& builtin : builtinSurfaces)
+    {
+        if (surface->name == builtin.name)
+        {
+            fprintf(stderr, "%s: '%s' is a built-in device map\n", fileName, builtin.name);
+            return false;
+        }
+    }
+
+    // the names don't move anymore once they are all in place
+    for (size_t index = 0; index < controls.size(); index++)
+        surface->controls.push_back({ surface->names[index].c_str(), controls[index] });
+
+    if (!hasUniqueNames(surface->controls.data(), surface->controls.size()))
+    {
+        fprintf(stderr, "%s: duplicate control name\n", fileName);
+        return false;
+    }
+
+    if (!hasValidChannels(surface->controls.data(), surface->controls.size()))
+    {
+        fprintf(stderr, "%s: duplicate channel\n", fileName);
+        return false;
+    }
+
+    surface->hash = makeControlHash(surface->controls.data(), surface->controls.size());
+    if (!surface->hash.valid)
     {
+        fprintf(stderr, "%s: couldn't build the lookup table for %d controls\n", fileName, int(surface->controls.size()));
         return false;
     }
 
-    out = (*controlSurfaceMap)[name];
+    for (auto& loaded : loadedSurfaces)
+    {
+        if (loaded->name == surface->name)
+        {
+            loaded = std::move(surface);
+            return true;
+        }
+    }
+
+    loadedSurfaces.push_back(std::move(surface));
     return true;
 }
@@ -20,6 +20,13 @@
 * DEALINGS IN THE SOFTWARE.
 */
 
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
 struct ControlSurface
 {
     typedef enum {
@@ -32,10 +39,152 @@ struct ControlSurface
     int channel;
 
     ControlSurface() = default;
-    ControlSurface(Type t, int c)
+    constexpr ControlSurface(Type t, int c)
         : type(t), channel(c)
     { }
 };
 
-bool setControlSurfaceType(const char *name);
-bool mapControl(ControlSurface& out, const char *name);
+// A named control of a device map
+struct ControlAlias
+{
+    const char *name;
+    ControlSurface control;
+};
+
+// Perfect hash of the control names of a device map: a name's bucket selects the displacement
+// that puts it into a slot of its own. Channels are unique, so a map has at most 128 controls.
+#define CONTROL_HASH_MAX_CONTROLS 128
+#define CONTROL_HASH_BUCKETS 64
+#define CONTROL_HASH_SLOTS 256
+
+struct ControlHash
+{
+    uint16_t displacements[CONTROL_HASH_BUCKETS];
+    unsigned char slots[CONTROL_HASH_SLOTS]; // index of the control + 1, 0 for an empty slot
+    bool valid; // false if the controls couldn't be placed
+};
+
+constexpr bool namesEqual(const char *a, const char *b)
+{
+    while (*a && *a == *b)
+    {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+// FNV-1a
+constexpr uint32_t hashControlName(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    while (*name)
+    {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+constexpr uint32_t getControlHashSlot(uint32_t hash, uint32_t displacement)
+{
+    return ((hash ^ (displacement * 0x9e3779b9u)) * 0x85ebca6bu) >> 24;
+}
+
+// Places the controls of a device map into the slots of a perfect hash. Used at compile time
+// for the built-in maps and at runtime for loaded ones.
+constexpr ControlHash makeControlHash(const ControlAlias *controls, size_t count)
+{
+    ControlHash hash = {};
+    if (count > CONTROL_HASH_MAX_CONTROLS)
+        return hash;
+
+    uint32_t hashes[CONTROL_HASH_MAX_CONTROLS] = {};
+    int bucketSizes[CONTROL_HASH_BUCKETS] = {};
+    for (size_t index = 0; index < count; index++)
+    {
+        hashes[index] = hashControlName(controls[index].name);
+        bucketSizes[hashes[index] % CONTROL_HASH_BUCKETS]++;
+    }
+
+    // the largest buckets are placed first, while most slots are still free
+    for (;;)
+    {
+        uint32_t bucket = 0;
+        for (uint32_t other = 1; other < CONTROL_HASH_BUCKETS; other++)
+            if (bucketSizes[other] > bucketSizes[bucket])
+                bucket = other;
+
+        if (bucketSizes[bucket] <= 0)
+            break;
+        bucketSizes[bucket] = -1;
+
+        uint32_t displacement = 0;
+        for (; displacement <= 0xffff; displacement++)
+        {
+            size_t index = 0;
+            for (; index < count; index++)
+            {
+                if (hashes[index] % CONTROL_HASH_BUCKETS != bucket)
+                    continue;
+
+                unsigned char& slot = hash.slots[getControlHashSlot(hashes[index], displacement)];
+                if (slot)
+                    break;
+                slot = (unsigned char)(index + 1);
+            }
+
+            if (index == count)
+                break;
+
+            // take back the controls of this bucket that were placed with this displacement
+            for (size_t placed = 0; placed < index; placed++)
+                if (hashes[placed] % CONTROL_HASH_BUCKETS == bucket)
+                    hash.slots[getControlHashSlot(hashes[placed], displacement)] = 0;
+        }
+
+        if (displacement > 0xffff)
+            return hash;
+
+        hash.displacements[bucket] = (uint16_t)displacement;
+    }
+
+    hash.valid = true;
+    return hash;
+}
+
+constexpr bool hasUniqueNames(const ControlAlias *controls, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        for (size_t j = i + 1; j < count; j++)
+            if (namesEqual(controls[i].name, controls[j].name))
+                return false;
+    return true;
+}
+
+constexpr bool hasValidChannels(const ControlAlias *controls, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (controls[i].control.channel < 0 || controls[i].control.channel >= 128)
+            return false;
+        for (size_t j = i + 1; j < count; j++)
+            if (controls[i].control.channel == controls[j].control.channel)
+                return false;
+    }
+    return true;
+}
+
+struct LoadedSurface;
+
+// Device maps loaded from definition files. Every config holds its own list, so the maps that a
+// rejected config loaded never replace the ones in use.
+typedef std::vector<std::shared_ptr<const LoadedSurface>> LoadedSurfaces;
+
+// Look up a built-in map or one of 'loaded'
+bool isControlSurfaceType(const char *name, const LoadedSurfaces& loaded);
+bool mapControl(ControlSurface& out, const char *surfaceType, const char *name, const LoadedSurfaces& loaded);
+
+// Adds the device map defined in a file to 'loaded', or replaces a map that was loaded before under
+// the same name. Errors are reported to stderr.
+bool loadControlSurfaceDefinition(const char *fileName, LoadedSurfaces& loaded);
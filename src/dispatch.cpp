@@ -0,0 +1,1246 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#define NOMINMAX
+
+#include "dispatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+
+#ifdef _WIN32
+#include <WS2tcpip.h>
+#else
+#include <unistd.h>
+#include <errno.h>
+
+// Function shims
+#define InetPton inet_pton
+#endif
+
+#include "binary_protocol.h"
+#include "flight_recorder.h"
+#include "logger.h"
+#include "metrics.h"
+#include "trace.h"
+#include "uring_sender.h"
+
+static_assert(BINARY_MAX_DATAGRAM == MAX_RCON_MESSAGE, "binary datagrams are built in PacketBatch");
+
+using namespace std;
+
+#ifdef _WIN32
+WSADATA g_wsaData = {};
+SOCKET g_SendSocket = 0;
+#else
+int g_SendSocket = 0;
+UringSender g_uringSender;
+#endif
+
+unique_ptr<DispatchTable> g_dispatch;
+int g_batchDepth = 0;
+
+// The event being handled, and the events whose packets wait in the current batch
+#define MAX_TRACED_SENDS 256
+EventTimes g_currentEvent;
+EventTimes g_tracedSends[MAX_TRACED_SENDS];
+int g_tracedSendCount = 0;
+
+// Coalescing state of a knob or slider: the latest value that hasn't been sent yet
+// and the earliest time when the channel may be sent again
+struct PendingKnob
+{
+	int value = -1;
+	Clock::time_point next_send;
+	EventTimes times; // of the event that delivered 'value'
+};
+
+PendingKnob g_pendingKnobs[MAX_MIDI_DEVICES * MIDI_CHANNEL_COUNT];
+
+// The last value accepted for a knob or slider, which has been sent or is pending,
+// and the direction in which it moved to get there
+struct KnobFilter
+{
+	int value = -1;
+	int direction = 0;
+};
+
+KnobFilter g_knobFilters[MAX_MIDI_DEVICES * MIDI_CHANNEL_COUNT];
+
+// Interpolation state of a knob with smoothing: the value last sent, which moves toward
+// the MIDI value 'target' on every tick while the knob is active
+struct SmoothedKnob
+{
+	bool valid = false;  // false until the first value has been sent
+	bool active = false; // false once 'value' has reached the target
+	float value = 0.f;
+	int target = 0;
+	Clock::time_point updated;
+	EventTimes times; // of the event that delivered 'target'
+};
+
+SmoothedKnob g_smoothedKnobs[MAX_MIDI_DEVICES * MIDI_CHANNEL_COUNT];
+Clock::time_point g_nextSmoothingTick;
+
+// When resync snapshots are due. The values that snapshots send again, so that a lost update
+// doesn't leave the receivers at a stale value, are in DispatchTable::knob_values.
+struct ResyncState
+{
+	bool idle_pending = false; // a knob has moved since the last snapshot
+	Clock::time_point last_activity;
+	Clock::time_point next_snapshot;
+};
+
+ResyncState g_resync;
+
+bool OpenSocket()
+{
+#ifdef _WIN32
+	//Startup WinSock
+	if (0 != WSAStartup(MAKEWORD(2, 2), &g_wsaData))
+	{
+		fprintf(stderr, "error: failed to initialize WinSock\n");
+		return false;
+	}
+#endif
+
+	// Setup broadcast socket, the targets are resolved by CompileDispatchTable()
+	g_SendSocket = socket(AF_INET, SOCK_DGRAM, 0);
+
+	for (const TargetConfig& target : g_config.targets)
+	{
+		if (target.format == OutputFormat::Text)
+			printf("korgi: writing updates to %s\n", target.address == "-" ? "stdout" : target.address.c_str());
+		else
+			printf("korgi: connected to %s:%d\n", target.address.c_str(), target.port);
+	}
+
+	return true;
+}
+
+void CloseSocket()
+{
+#ifdef _WIN32
+	closesocket(g_SendSocket);
+	g_SendSocket = 0;
+	WSACleanup();
+#else
+	g_uringSender.Close();
+	close(g_SendSocket);
+	g_SendSocket = 0;
+#endif
+}
+
+#ifndef _WIN32
+int GetSocketDescriptor()
+{
+	return g_SendSocket;
+}
+
+bool OpenUringTransport(int bufferCount)
+{
+	return g_uringSender.Open(g_SendSocket, bufferCount, MAX_RCON_MESSAGE);
+}
+
+void CloseUringTransport()
+{
+	g_uringSender.Close();
+}
+
+void ReceiveReplies()
+{
+	// Q2PRO replies to rcon commands with out-of-band print packets
+	static const char printHeader[] = "\xff\xff\xff\xffprint\n";
+	const int printHeaderLength = int(sizeof(printHeader) - 1);
+
+	char buffer[MAX_RCON_MESSAGE + 1];
+	for (;;)
+	{
+		int length = int(recv(g_SendSocket, buffer, MAX_RCON_MESSAGE, MSG_DONTWAIT));
+		if (length < 0)
+			break;
+
+		if (length <= printHeaderLength || memcmp(buffer, printHeader, printHeaderLength))
+			continue;
+
+		CountMetric(Metric::Replies);
+
+		buffer[length] = 0;
+
+		char* line = buffer + printHeaderLength;
+		while (char* end = strchr(line, '\n'))
+		{
+			*end = 0;
+			if (*line)
+				LogReply(line);
+			line = end + 1;
+		}
+
+		if (*line)
+			LogReply(line);
+	}
+}
+#endif
+
+int64_t ToNanoseconds(Clock::duration duration)
+{
+	return chrono::duration_cast<chrono::nanoseconds>(duration).count();
+}
+
+void TraceDequeue(Clock::time_point dequeued)
+{
+	g_currentEvent.dequeued = dequeued;
+	g_currentEvent.dispatched = dequeued;
+}
+
+void TraceSent()
+{
+	Clock::time_point sent = Clock::now();
+
+	for (int i = 0; i < g_tracedSendCount; i++)
+	{
+		TraceRecord(TraceInterval::Send, ToNanoseconds(sent - g_tracedSends[i].dispatched));
+		TraceRecord(TraceInterval::Total, ToNanoseconds(sent - g_tracedSends[i].dequeued));
+	}
+
+	g_tracedSendCount = 0;
+}
+
+// Remembers the current event until the packet that carries it has been sent.
+// Packets that don't belong to an event, such as resync snapshots, aren't traced.
+void TraceCurrentEvent()
+{
+	if (g_config.trace && g_currentEvent.dequeued != Clock::time_point() && g_tracedSendCount < MAX_TRACED_SENDS)
+		g_tracedSends[g_tracedSendCount++] = g_currentEvent;
+}
+
+#ifndef _WIN32
+// Sends the payloads of the packet sets in [firstSet, lastSet) to their UDP targets with one sendmmsg call
+void SendMessages(DispatchTable& table, int firstSet, int lastSet)
+{
+	for (int set = firstSet; set < lastSet; set++)
+	{
+		table.payloads[set].iov_base = (void*)table.packet_sets[set].payload;
+		table.payloads[set].iov_len = table.packet_sets[set].payload_length;
+	}
+
+	const PacketSet& last = table.packet_sets[lastSet - 1];
+	int first = table.packet_sets[firstSet].first_target;
+	int count = last.first_target + last.target_count - first;
+	mmsghdr* messages = table.messages.data() + first;
+
+	while (count > 0)
+	{
+		int sent = sendmmsg(g_SendSocket, messages, count, 0);
+		if (sent < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			// skip the target that failed, the others should still get the update
+			CountMetric(Metric::SendErrors);
+			messages++;
+			count--;
+			continue;
+		}
+
+		unsigned bytes = 0;
+		for (int i = 0; i < sent; i++)
+			bytes += messages[i].msg_len;
+
+		CountMetric(Metric::PacketsSent, unsigned(sent));
+		CountMetric(Metric::BytesSent, bytes);
+
+		messages += sent;
+		count -= sent;
+	}
+}
+
+// Queues the payloads of the packet sets in [firstSet, lastSet) for their UDP targets and submits them
+// with one io_uring call. Completions are reaped by later calls.
+void SubmitToRing(DispatchTable& table, int firstSet, int lastSet)
+{
+	for (int set = firstSet; set < lastSet; set++)
+	{
+		const PacketSet& packets = table.packet_sets[set];
+
+		// file outputs have no UDP targets, and 'targets' may be empty
+		if (!packets.target_count)
+			continue;
+
+		g_uringSender.Send(packets.payload, packets.payload_length, &table.targets[packets.first_target], packets.target_count);
+	}
+
+	g_uringSender.Submit();
+}
+#endif
+
+// Sends the current payload of each packet set in [firstSet, lastSet) to all of its targets.
+// On Linux, all UDP targets are served by a single sendmmsg call or io_uring submission;
+// text outputs are written to their files.
+void SendToTargets(DispatchTable& table, int firstSet, int lastSet)
+{
+	for (int set = firstSet; set < lastSet; set++)
+	{
+		const PacketSet& packets = table.packet_sets[set];
+		if (packets.file)
+		{
+			fwrite(packets.payload, 1, packets.payload_length, packets.file.get());
+			fflush(packets.file.get());
+		}
+	}
+
+#ifdef _WIN32
+	for (int set = firstSet; set < lastSet; set++)
+	{
+		const PacketSet& packets = table.packet_sets[set];
+		for (int target = packets.first_target; target < packets.first_target + packets.target_count; target++)
+		{
+			int sent = sendto(g_SendSocket, packets.payload, packets.payload_length, 0, (sockaddr*)&table.targets[target], sizeof(sockaddr_in));
+			if (sent < 0)
+				CountMetric(Metric::SendErrors);
+			else
+			{
+				CountMetric(Metric::PacketsSent);
+				CountMetric(Metric::BytesSent, unsigned(sent));
+			}
+		}
+	}
+#else
+	if (g_uringSender.IsOpen())
+		SubmitToRing(table, firstSet, lastSet);
+	else
+		SendMessages(table, firstSet, lastSet);
+#endif
+
+	for (int set = firstSet; set < lastSet; set++)
+	{
+		const PacketSet& packets = table.packet_sets[set];
+		RecordFlightSend(packets.payload_length, packets.target_count + (packets.file ? 1 : 0));
+	}
+
+	if (g_tracedSendCount)
+		TraceSent();
+}
+
+// Points the payload of a packet set at its batch, which is then considered sent
+void FinishBatch(PacketSet& packets)
+{
+	PacketBatch& batch = packets.batch;
+	int length = batch.length + packets.encoder->terminator_length;
+
+	packets.encoder->Finish(batch.message, length, batch.count, packets.sequence++);
+	packets.payload = batch.message;
+	packets.payload_length = length;
+
+	batch.length = 0;
+	batch.count = 0;
+}
+
+void SendBatch(DispatchTable& table, int set)
+{
+	PacketSet& packets = table.packet_sets[set];
+	if (!packets.batch.count)
+		return;
+
+	FinishBatch(packets);
+	SendToTargets(table, set, set + 1);
+}
+
+// Joins an encoded update to the batch of a packet set, sending the batch first if it doesn't fit
+void AddToBatch(DispatchTable& table, int set, const char* update, int update_length)
+{
+	PacketSet& packets = table.packet_sets[set];
+	PacketBatch& batch = packets.batch;
+	const OutputEncoder& encoder = *packets.encoder;
+
+	if (batch.count && batch.length + encoder.separator_length + update_length + encoder.terminator_length > MAX_RCON_MESSAGE)
+		SendBatch(table, set);
+
+	if (!batch.count)
+	{
+		memcpy(batch.message, packets.arena.data(), packets.header_length);
+		batch.length = packets.header_length;
+	}
+	else
+	{
+		memcpy(batch.message + batch.length, encoder.separator, encoder.separator_length);
+		batch.length += encoder.separator_length;
+	}
+
+	memcpy(batch.message + batch.length, update, update_length);
+	batch.length += update_length;
+	batch.count++;
+
+	memset(batch.message + batch.length, 0, encoder.terminator_length);
+}
+
+// The update of a pre-rendered packet, without the header and the terminator
+const char* GetPacketUpdate(const PacketSet& packets, int index, int& length)
+{
+	const PacketRef& packet = packets.packets[index];
+	length = int(packet.length) - packets.header_length - packets.encoder->terminator_length;
+	return &packets.arena[packet.offset] + packets.header_length;
+}
+
+// Sends a pre-rendered packet to all targets, or joins its update to the current batch.
+// CompileDispatchTable() makes sure that every update fits into a single message.
+void SendPacket(int index)
+{
+	DispatchTable& table = *g_dispatch;
+	int setCount = int(table.packet_sets.size());
+
+	if (!g_batchDepth)
+	{
+		TraceCurrentEvent();
+
+		for (PacketSet& packets : table.packet_sets)
+		{
+			const PacketRef& packet = packets.packets[index];
+			packets.payload = &packets.arena[packet.offset];
+			packets.payload_length = int(packet.length);
+
+			// packets are complete except for what the encoder stamps at send time
+			packets.encoder->Finish(&packets.arena[packet.offset], int(packet.length), 1, packets.sequence++);
+		}
+
+		SendToTargets(table, 0, setCount);
+		return;
+	}
+
+	for (int set = 0; set < setCount; set++)
+	{
+		int length;
+		const char* update = GetPacketUpdate(table.packet_sets[set], index, length);
+		AddToBatch(table, set, update, length);
+	}
+
+	TraceCurrentEvent();
+}
+
+bool SendKnobValue(int control, const ChannelAction& knob, float value)
+{
+	DispatchTable& table = *g_dispatch;
+
+	char command[MAX_RCON_MESSAGE];
+	snprintf(command, sizeof(command), "%s %.3f", knob.command, value);
+
+	OutputUpdate update;
+	update.control = control;
+	update.name = knob.command;
+	update.value = value;
+	update.command = command;
+
+	// encoded updates are built here rather than pre-rendered, the buffer is kept between calls
+	static vector<char> encoded;
+	static vector<int> offsets;
+	encoded.clear();
+	offsets.clear();
+
+	for (const PacketSet& packets : table.packet_sets)
+	{
+		offsets.push_back(int(encoded.size()));
+		if (!packets.encoder->EncodeUpdate(update, encoded))
+			return false;
+
+		int length = int(encoded.size()) - offsets.back();
+		if (packets.header_length + length + packets.encoder->terminator_length > MAX_RCON_MESSAGE)
+			return false;
+	}
+
+	offsets.push_back(int(encoded.size()));
+
+	// a single value is a batch of one
+	BeginBatch();
+
+	for (int set = 0; set < int(table.packet_sets.size()); set++)
+		AddToBatch(table, set, encoded.data() + offsets[set], offsets[set + 1] - offsets[set]);
+
+	TraceCurrentEvent();
+
+	EndBatch();
+
+	return true;
+}
+
+void BeginBatch()
+{
+	g_batchDepth++;
+}
+
+void EndBatch()
+{
+	if (--g_batchDepth)
+		return;
+
+	DispatchTable& table = *g_dispatch;
+	int setCount = int(table.packet_sets.size());
+
+	// all sets receive the same commands, so normally every one of them has a message pending
+	// and the whole batch goes out with one call
+	bool allPending = true;
+	for (const PacketSet& packets : table.packet_sets)
+		allPending = allPending && packets.batch.count;
+
+	if (!allPending)
+	{
+		for (int set = 0; set < setCount; set++)
+			SendBatch(table, set);
+		return;
+	}
+
+	for (PacketSet& packets : table.packet_sets)
+		FinishBatch(packets);
+
+	SendToTargets(table, 0, setCount);
+}
+
+float GetKnobValue(const ChannelAction& knob, int midiValue)
+{
+	return knob.bias + knob.scale * float(midiValue);
+}
+
+void SendKnob(const ChannelAction& knob, int midiValue)
+{
+	SendPacket(knob.first_packet + midiValue);
+}
+
+// Moves a smoothed knob toward its target, or right onto it if 'force' is set.
+// Returns false once the knob has converged and gone idle.
+bool StepSmoothedKnob(int control, const ChannelAction& knob, SmoothedKnob& smoothed, Clock::time_point now, bool force)
+{
+	float target = GetKnobValue(knob, smoothed.target);
+	float elapsed = chrono::duration<float>(now - smoothed.updated).count();
+	smoothed.updated = now;
+	g_currentEvent = smoothed.times;
+
+	long previous = lround(smoothed.value * 1000.f);
+
+	if (!force)
+		smoothed.value += (target - smoothed.value) * (1.f - exp(-elapsed / knob.smoothing));
+
+	// the remaining tail of the curve is invisible once the value is within a small fraction
+	// of a MIDI step, so the knob is finished with the exact pre-rendered packet
+	if (force || fabs(target - smoothed.value) < max(0.0005f, 0.05f * fabs(knob.scale)))
+	{
+		smoothed.value = target;
+		smoothed.active = false;
+		SendKnob(knob, smoothed.target);
+		return false;
+	}
+
+	// commands have three decimals, smaller steps would repeat the last one
+	if (lround(smoothed.value * 1000.f) != previous)
+		SendKnobValue(control, knob, smoothed.value);
+
+	return true;
+}
+
+// Advances all active smoothed knobs if a tick is due, returns the time of the next tick
+Clock::time_point UpdateSmoothedKnobs(Clock::time_point now, bool force)
+{
+	const DispatchTable& table = *g_dispatch;
+	bool tick = force || now >= g_nextSmoothingTick;
+	bool active = false;
+
+	for (int control = 0; control < table.control_count; control++)
+	{
+		SmoothedKnob& smoothed = g_smoothedKnobs[control];
+		if (!smoothed.active)
+			continue;
+
+		const ChannelAction& knob = table.channels[control];
+		if (knob.type != ChannelAction::Type::Knob || knob.smoothing <= 0.f)
+		{
+			// mapping went away or changed with a config reload
+			smoothed = SmoothedKnob();
+			continue;
+		}
+
+		if (tick)
+			active = StepSmoothedKnob(control, knob, smoothed, now, force) || active;
+		else
+			active = true;
+	}
+
+	if (!active)
+		return Clock::time_point::max();
+
+	// ticks keep a fixed rate unless the loop has fallen behind
+	if (tick)
+	{
+		g_nextSmoothingTick += table.smoothing_tick;
+		if (g_nextSmoothingTick <= now)
+			g_nextSmoothingTick = now + table.smoothing_tick;
+	}
+
+	return g_nextSmoothingTick;
+}
+
+// Starts ramping a smoothed knob toward a new MIDI value
+void SmoothKnob(const ChannelAction& knob, int control, int midiValue)
+{
+	SmoothedKnob& smoothed = g_smoothedKnobs[control];
+	smoothed.target = midiValue;
+	smoothed.times = g_currentEvent;
+
+	// there is nothing to ramp from before the first value
+	if (!smoothed.valid)
+	{
+		smoothed.valid = true;
+		smoothed.value = GetKnobValue(knob, midiValue);
+		SendKnob(knob, midiValue);
+		return;
+	}
+
+	if (!smoothed.active)
+	{
+		smoothed.active = true;
+		smoothed.updated = Clock::now();
+	}
+}
+
+// Sends the current value of every knob in all banks that isn't ramping, joined into as few packets as possible
+void SendResyncSnapshot()
+{
+	const DispatchTable& table = *g_dispatch;
+	g_currentEvent = EventTimes();
+
+	BeginBatch();
+
+	for (size_t knob = 0; knob < table.knob_values.size(); knob++)
+	{
+		int value = table.knob_values[knob];
+		int index = table.knob_actions[knob];
+		if (value < 0 || index < 0)
+			continue;
+
+		int control = index % table.control_count;
+		if (table.channels[control].knob == int(knob) && g_smoothedKnobs[control].active)
+			continue;
+
+		SendKnob(table.actions[index], value);
+	}
+
+	EndBatch();
+
+	CountMetric(Metric::ResyncSnapshots);
+}
+
+// Sends a snapshot once the knobs have been idle for a while, and at the resync interval.
+// 'idle' is set when no knob update is waiting. Returns the time when the next snapshot may be due.
+Clock::time_point UpdateResync(Clock::time_point now, bool idle)
+{
+	const DispatchTable& table = *g_dispatch;
+	Clock::time_point next_due = Clock::time_point::max();
+	bool snapshot = false;
+
+	// while updates are waiting, the loop wakes up for them anyway
+	if (table.resync_idle > Clock::duration::zero() && g_resync.idle_pending && idle)
+	{
+		Clock::time_point due = g_resync.last_activity + table.resync_idle;
+		if (now >= due)
+			snapshot = true;
+		else
+			next_due = due;
+	}
+
+	if (table.resync_interval > Clock::duration::zero())
+	{
+		if (g_resync.next_snapshot == Clock::time_point())
+			g_resync.next_snapshot = now + table.resync_interval;
+
+		if (now >= g_resync.next_snapshot)
+			snapshot = true;
+		else
+			next_due = min(next_due, g_resync.next_snapshot);
+	}
+
+	if (snapshot)
+	{
+		SendResyncSnapshot();
+		g_resync.idle_pending = false;
+
+		if (table.resync_interval > Clock::duration::zero())
+		{
+			g_resync.next_snapshot = now + table.resync_interval;
+			next_due = min(next_due, g_resync.next_snapshot);
+		}
+	}
+
+	return next_due;
+}
+
+uint64_t GetResyncSnapshotCount()
+{
+	return GetMetric(Metric::ResyncSnapshots);
+}
+
+Clock::time_point FlushPendingKnobs(Clock::time_point now, bool force)
+{
+	// the knobs are traced as the events that delivered their values
+	EventTimes currentEvent = g_currentEvent;
+
+	BeginBatch();
+
+	Clock::time_point next_due = UpdateSmoothedKnobs(now, force);
+
+	for (int control = 0; control < g_dispatch->control_count; control++)
+	{
+		PendingKnob& pending = g_pendingKnobs[control];
+		if (pending.value < 0)
+			continue;
+
+		const ChannelAction& knob = g_dispatch->channels[control];
+		if (knob.type != ChannelAction::Type::Knob)
+		{
+			// mapping went away with a config reload
+			pending.value = -1;
+			continue;
+		}
+
+		if (!force && now < pending.next_send)
+		{
+			next_due = min(next_due, pending.next_send);
+			continue;
+		}
+
+		g_currentEvent = pending.times;
+		SendKnob(knob, pending.value);
+		pending.value = -1;
+		pending.next_send = now + knob.interval;
+	}
+
+	// snapshots share the batch with the knobs that were just flushed
+	if (!force)
+		next_due = min(next_due, UpdateResync(now, next_due == Clock::time_point::max()));
+
+	EndBatch();
+
+	g_currentEvent = currentEvent;
+
+	return next_due;
+}
+
+void ResetKnobFilters()
+{
+	for (KnobFilter& filter : g_knobFilters)
+		filter = KnobFilter();
+
+	for (SmoothedKnob& smoothed : g_smoothedKnobs)
+		smoothed = SmoothedKnob();
+}
+
+uint64_t GetSuppressedUpdateCount()
+{
+	return GetMetric(Metric::SuppressedUpdates);
+}
+
+// Returns false if sending 'midiValue' would not change anything: its command is the same as
+// the last one, or it's a small step back that a worn potentiometer produces while at rest
+bool FilterKnob(const ChannelAction& knob, int control, int midiValue)
+{
+	KnobFilter& filter = g_knobFilters[control];
+
+	if (filter.value >= 0)
+	{
+		const vector<int>& outputs = g_dispatch->packet_outputs;
+		if (outputs[knob.first_packet + midiValue] == outputs[knob.first_packet + filter.value])
+			return false;
+
+		int delta = midiValue - filter.value;
+		int direction = delta > 0 ? 1 : -1;
+		if (direction != filter.direction && abs(delta) <= knob.deadband)
+			return false;
+
+		filter.direction = direction;
+	}
+
+	filter.value = midiValue;
+	return true;
+}
+
+void SelectBank(DispatchTable& table, int bank)
+{
+	// the channels change meaning, so nothing that was accepted for the old actions may follow
+	FlushPendingKnobs(Clock::now(), true);
+	ResetKnobFilters();
+
+	table.bank = bank;
+	table.channels = table.actions.data() + bank * table.control_count;
+}
+
+void HandleMidiInput(int device, unsigned char midiChannel, unsigned char midiValue)
+{
+	midiChannel &= MIDI_CHANNEL_COUNT - 1;
+	midiValue &= 0x7f;
+
+	int control = GetControlIndex(device, midiChannel);
+	if (device < 0 || control >= g_dispatch->control_count)
+		return;
+
+	const ChannelAction& action = g_dispatch->channels[control];
+
+	if (g_config.trace)
+	{
+		g_currentEvent.dispatched = Clock::now();
+		TraceRecord(TraceInterval::Dispatch, ToNanoseconds(g_currentEvent.dispatched - g_currentEvent.dequeued));
+	}
+
+	switch (action.type)
+	{
+	case ChannelAction::Type::Button:
+		if (midiValue > 0)
+		{
+			LogButton(control, action.command);
+
+			// knob values that are still waiting go out first so that the command
+			// sees the state the user has set up before pressing the button
+			BeginBatch();
+			FlushPendingKnobs(Clock::now(), true);
+			SendPacket(action.first_packet);
+			EndBatch();
+		}
+		break;
+
+	case ChannelAction::Type::Knob:
+	{
+		if (!FilterKnob(action, control, midiValue))
+		{
+			CountMetric(Metric::SuppressedUpdates);
+			break;
+		}
+
+		LogKnob(control, action.command, GetKnobValue(action, midiValue));
+
+		g_dispatch->knob_values[action.knob] = midiValue;
+		g_resync.last_activity = Clock::now();
+		g_resync.idle_pending = true;
+
+		// smoothed knobs are sent by the ticks of FlushPendingKnobs instead of the rate limit
+		if (action.smoothing > 0.f)
+		{
+			SmoothKnob(action, control, midiValue);
+			break;
+		}
+
+		// send right away if the channel has been quiet for a whole interval,
+		// otherwise keep the latest value until FlushPendingKnobs picks it up
+		PendingKnob& pending = g_pendingKnobs[control];
+		Clock::time_point now = Clock::now();
+		pending.value = midiValue;
+		pending.times = g_currentEvent;
+
+		if (now >= pending.next_send)
+		{
+			SendKnob(action, midiValue);
+			pending.value = -1;
+			pending.next_send = now + action.interval;
+		}
+		break;
+	}
+
+	case ChannelAction::Type::Bank:
+		if (midiValue > 0)
+		{
+			LogButton(control, action.command);
+
+			int bankCount = int(g_dispatch->bank_names.size());
+			int bank = action.bank;
+			if (bank == ChannelAction::NextBank)
+				bank = (g_dispatch->bank + 1) % bankCount;
+			else if (bank == ChannelAction::PreviousBank)
+				bank = (g_dispatch->bank + bankCount - 1) % bankCount;
+
+			SelectBank(*g_dispatch, bank);
+		}
+		break;
+
+	default:
+		CountMetric(Metric::UnmappedEvents);
+		LogUnmapped(control, midiValue);
+		break;
+	}
+}
+
+bool AddPacket(PacketSet& packets, const OutputUpdate& update)
+{
+	PacketRef packet = { uint32_t(packets.arena.size()), 0 };
+
+	// the header is copied from the start of the arena
+	packets.arena.resize(packet.offset + packets.header_length);
+	// pointer arithmetic rather than operator[], the header may be empty and the offset at the end
+	memcpy(packets.arena.data() + packet.offset, packets.arena.data(), packets.header_length);
+
+	if (!packets.encoder->EncodeUpdate(update, packets.arena))
+	{
+		fprintf(stderr, "%s: command can't be encoded for this output: %s\n", g_configFileName.c_str(), update.command);
+		return false;
+	}
+
+	packets.arena.resize(packets.arena.size() + packets.encoder->terminator_length, 0);
+	packet.length = uint32_t(packets.arena.size() - packet.offset);
+
+	if (packet.length > MAX_RCON_MESSAGE)
+	{
+		fprintf(stderr, "%s: command is too long for a packet: %s\n", g_configFileName.c_str(), update.command);
+		return false;
+	}
+
+	packets.packets.push_back(packet);
+	packets.encoder->Finish(packets.arena.data() + packet.offset, int(packet.length), 1, 0);
+
+	return true;
+}
+
+// Fills the actions of one device's channels from a set of mappings, replacing what was there,
+// and appends the commands and updates of their packets. OutputUpdate::command is set once
+// all commands are known.
+void CompileMappings(const KorgiConfig& config, int device, const unordered_map<int, string>& buttons, const unordered_map<int, KnobMapping>& knobs,
+	ChannelAction* channels, size_t* nameOffsets, DispatchTable& table, vector<string>& commands, vector<OutputUpdate>& updates)
+{
+	for (const auto& knob : knobs)
+	{
+		if (knob.first < 0 || knob.first >= MIDI_CHANNEL_COUNT || buttons.count(knob.first))
+			continue;
+
+		int control = GetControlIndex(device, knob.first);
+		const KnobMapping& mapping = knob.second;
+		ChannelAction& action = channels[control];
+		action = ChannelAction();
+		action.type = ChannelAction::Type::Knob;
+		action.scale = (mapping.max_value - mapping.min_value) / 127.f;
+		action.bias = mapping.min_value;
+		action.first_packet = int(commands.size());
+		action.knob = int(table.knob_values.size());
+		table.knob_values.push_back(-1);
+
+		float rate = mapping.rate >= 0.f ? mapping.rate : config.rate;
+		if (rate > 0.f)
+			action.interval = chrono::duration_cast<Clock::duration>(chrono::duration<float>(1.f / rate));
+
+		action.deadband = mapping.deadband >= 0 ? mapping.deadband : config.deadband;
+		action.smoothing = mapping.smoothing;
+
+		for (int value = 0; value < 128; value++)
+		{
+			char command[MAX_RCON_MESSAGE];
+			snprintf(command, sizeof(command), "%s %.3f", mapping.name.c_str(), GetKnobValue(action, value));
+
+			// the mapping is monotonic, so equal commands are always adjacent
+			if (value > 0 && commands.back() == command)
+				table.packet_outputs.push_back(table.packet_outputs.back());
+			else
+				table.packet_outputs.push_back(int(commands.size()));
+
+			commands.push_back(command);
+
+			OutputUpdate update;
+			update.control = control;
+			update.name = mapping.name.c_str();
+			update.value = GetKnobValue(action, value);
+			updates.push_back(update);
+		}
+
+		nameOffsets[control] = table.names.size();
+		table.names.insert(table.names.end(), mapping.name.c_str(), mapping.name.c_str() + mapping.name.size() + 1);
+	}
+
+	for (const auto& button : buttons)
+	{
+		if (button.first < 0 || button.first >= MIDI_CHANNEL_COUNT)
+			continue;
+
+		int control = GetControlIndex(device, button.first);
+		ChannelAction& action = channels[control];
+		action = ChannelAction();
+		action.type = ChannelAction::Type::Button;
+		action.first_packet = int(commands.size());
+		table.packet_outputs.push_back(int(commands.size()));
+		commands.push_back(button.second);
+
+		OutputUpdate update;
+		update.control = control;
+		update.button = true;
+		update.name = button.second.c_str();
+		update.value = 1.f;
+		updates.push_back(update);
+
+		nameOffsets[control] = table.names.size();
+		table.names.insert(table.names.end(), button.second.c_str(), button.second.c_str() + button.second.size() + 1);
+	}
+}
+
+// Fills the actions of one device's channels in every bank. Mappings outside of bank sections
+// are compiled once and shared by all banks, and bank buttons replace everything else.
+void CompileDeviceActions(const KorgiConfig& config, int device, DispatchTable& table, vector<string>& commands, vector<OutputUpdate>& updates, vector<size_t>& nameOffsets)
+{
+	const DeviceConfig& deviceConfig = config.devices[device];
+	int bankCount = int(table.bank_names.size());
+
+	CompileMappings(config, device, deviceConfig.buttons, deviceConfig.knobs, &table.actions[0], &nameOffsets[0], table, commands, updates);
+
+	int first = GetControlIndex(device, 0);
+	for (int bank = 1; bank < bankCount; bank++)
+	{
+		int offset = bank * table.control_count;
+		copy(table.actions.begin() + first, table.actions.begin() + first + MIDI_CHANNEL_COUNT, table.actions.begin() + offset + first);
+		copy(nameOffsets.begin() + first, nameOffsets.begin() + first + MIDI_CHANNEL_COUNT, nameOffsets.begin() + offset + first);
+	}
+
+	for (int bank = 0; bank < bankCount && bank < int(deviceConfig.banks.size()); bank++)
+	{
+		int offset = bank * table.control_count;
+		const BankMappings& mappings = deviceConfig.banks[bank];
+		CompileMappings(config, device, mappings.buttons, mappings.knobs, &table.actions[offset], &nameOffsets[offset], table, commands, updates);
+	}
+
+	for (const auto& button : deviceConfig.bank_buttons)
+	{
+		if (button.first < 0 || button.first >= MIDI_CHANNEL_COUNT)
+			continue;
+
+		ChannelAction action;
+		action.type = ChannelAction::Type::Bank;
+		if (button.second == "next")
+			action.bank = ChannelAction::NextBank;
+		else if (button.second == "previous")
+			action.bank = ChannelAction::PreviousBank;
+		else
+			action.bank = int(find(config.banks.begin(), config.banks.end(), button.second) - config.banks.begin());
+
+		// the log shows the command that a bank button stands for
+		string command = "bank " + button.second;
+		size_t nameOffset = table.names.size();
+		table.names.insert(table.names.end(), command.c_str(), command.c_str() + command.size() + 1);
+
+		int control = GetControlIndex(device, button.first);
+		for (int bank = 0; bank < bankCount; bank++)
+		{
+			table.actions[bank * table.control_count + control] = action;
+			nameOffsets[bank * table.control_count + control] = nameOffset;
+		}
+	}
+}
+
+bool CompileDispatchTable(const KorgiConfig& config, DispatchTable& table)
+{
+	// console command and update of every packet, in the order of packet indices
+	vector<string> commands;
+	vector<OutputUpdate> updates;
+
+	table.control_count = GetControlIndex(int(config.devices.size()), 0);
+	table.bank_names = config.banks;
+	if (table.bank_names.empty())
+		table.bank_names.push_back(string());
+
+	int actionCount = int(table.bank_names.size()) * table.control_count;
+	table.actions.assign(actionCount, ChannelAction());
+
+	if (config.smoothing_rate > 0.f)
+		table.smoothing_tick = chrono::duration_cast<Clock::duration>(chrono::duration<float>(1.f / config.smoothing_rate));
+
+	table.resync_interval = chrono::duration_cast<Clock::duration>(chrono::duration<float>(config.resync_interval));
+	table.resync_idle = chrono::duration_cast<Clock::duration>(chrono::duration<float>(config.resync_idle));
+
+	// the name buffer grows while it is filled, so names are located by offset until the end
+	vector<size_t> nameOffsets(actionCount, 0);
+
+	for (int device = 0; device < int(config.devices.size()); device++)
+		CompileDeviceActions(config, device, table, commands, updates, nameOffsets);
+
+	for (size_t index = 0; index < updates.size(); index++)
+		updates[index].command = commands[index].c_str();
+
+	table.knob_actions.assign(table.knob_values.size(), -1);
+	for (int index = 0; index < actionCount; index++)
+	{
+		ChannelAction& action = table.actions[index];
+		if (action.type != ChannelAction::Type::None)
+			action.command = table.names.data() + nameOffsets[index];
+
+		if (action.type == ChannelAction::Type::Knob && table.knob_actions[action.knob] < 0)
+			table.knob_actions[action.knob] = index;
+	}
+
+	// the selected bank and the values for resync snapshots carry over from the previous table
+	// for the banks and knob mappings that are still there
+	table.bank = 0;
+	if (g_dispatch)
+	{
+		const DispatchTable& previous = *g_dispatch;
+		auto bank = find(table.bank_names.begin(), table.bank_names.end(), previous.bank_names[previous.bank]);
+		if (bank != table.bank_names.end())
+			table.bank = int(bank - table.bank_names.begin());
+
+		// knob mappings are identified by control and variable name
+		unordered_map<string, int> previousValues;
+		for (size_t knob = 0; knob < previous.knob_actions.size(); knob++)
+		{
+			int index = previous.knob_actions[knob];
+			if (index >= 0 && previous.knob_values[knob] >= 0)
+				previousValues[to_string(index % previous.control_count) + " " + previous.actions[index].command] = previous.knob_values[knob];
+		}
+
+		for (size_t knob = 0; knob < table.knob_actions.size(); knob++)
+		{
+			int index = table.knob_actions[knob];
+			if (index < 0)
+				continue;
+
+			auto value = previousValues.find(to_string(index % table.control_count) + " " + table.actions[index].command);
+			if (value != previousValues.end())
+				table.knob_values[knob] = value->second;
+		}
+	}
+
+	table.channels = table.actions.data() + table.bank * table.control_count;
+
+	// UDP targets that share a format and password share a packet set, text outputs get one each
+	vector<int> targetSets(config.targets.size(), -1);
+	for (size_t index = 0; index < config.targets.size(); index++)
+	{
+		const TargetConfig& target = config.targets[index];
+		bool usesPassword = target.format == OutputFormat::Rcon || target.format == OutputFormat::Binary;
+		string password = !usesPassword ? string() : target.password.empty() ? config.password : target.password;
+		string fileName = target.format == OutputFormat::Text ? target.address : string();
+
+		int set = 0;
+		while (set < int(table.packet_sets.size()) && (table.packet_sets[set].format != target.format ||
+			table.packet_sets[set].password != password || table.packet_sets[set].file_name != fileName))
+			set++;
+
+		if (set == int(table.packet_sets.size()))
+		{
+			table.packet_sets.emplace_back();
+			PacketSet& packets = table.packet_sets.back();
+			packets.format = target.format;
+			packets.encoder = &GetOutputEncoder(target.format);
+			packets.password = password;
+			packets.file_name = fileName;
+
+			// receivers track the sequence across config reloads, and files aren't truncated
+			if (g_dispatch)
+			{
+				for (const PacketSet& previous : g_dispatch->packet_sets)
+				{
+					if (previous.format == packets.format && previous.password == packets.password && previous.file_name == packets.file_name)
+					{
+						packets.sequence = previous.sequence;
+						packets.file = previous.file;
+					}
+				}
+			}
+		}
+
+		if (target.format == OutputFormat::Text)
+			continue;
+
+		table.packet_sets[set].target_count++;
+		targetSets[index] = set;
+	}
+
+	int first_target = 0;
+	for (PacketSet& packets : table.packet_sets)
+	{
+		packets.first_target = first_target;
+		first_target += packets.target_count;
+	}
+
+	table.targets.resize(first_target);
+	vector<int> setFill(table.packet_sets.size(), 0);
+	for (size_t index = 0; index < config.targets.size(); index++)
+	{
+		if (targetSets[index] < 0)
+			continue;
+
+		const TargetConfig& target = config.targets[index];
+		const PacketSet& packets = table.packet_sets[targetSets[index]];
+		sockaddr_in& address = table.targets[packets.first_target + setFill[targetSets[index]]++];
+
+		address = {};
+		address.sin_port = htons(target.port);
+		address.sin_family = AF_INET;
+		if (0 == InetPton(AF_INET, target.address.c_str(), (void*)&address.sin_addr.s_addr))
+		{
+			fprintf(stderr, "%s: failed to translate the target IP address '%s'\n", g_configFileName.c_str(), target.address.c_str());
+			return false;
+		}
+	}
+
+	for (PacketSet& packets : table.packet_sets)
+	{
+		if (packets.format == OutputFormat::Text && !packets.file)
+		{
+			if (packets.file_name == "-")
+				packets.file = shared_ptr<FILE>(stdout, [](FILE*) {});
+			else
+				packets.file = shared_ptr<FILE>(fopen(packets.file_name.c_str(), "w"), [](FILE* file) { if (file) fclose(file); });
+
+			if (!packets.file.get())
+			{
+				fprintf(stderr, "%s: couldn't open the output file '%s'\n", g_configFileName.c_str(), packets.file_name.c_str());
+				return false;
+			}
+		}
+
+		packets.arena.clear();
+		packets.encoder->EncodeHeader(packets.password, packets.arena);
+		packets.header_length = int(packets.arena.size());
+		if (packets.header_length >= MAX_RCON_MESSAGE)
+		{
+			fprintf(stderr, "%s: password is too long\n", g_configFileName.c_str());
+			return false;
+		}
+
+		for (const OutputUpdate& update : updates)
+		{
+			if (!AddPacket(packets, update))
+				return false;
+		}
+	}
+
+#ifndef _WIN32
+	table.payloads.resize(table.packet_sets.size());
+	table.messages.resize(table.targets.size());
+
+	for (size_t set = 0; set < table.packet_sets.size(); set++)
+	{
+		const PacketSet& packets = table.packet_sets[set];
+		for (int target = packets.first_target; target < packets.first_target + packets.target_count; target++)
+		{
+			msghdr& message = table.messages[target].msg_hdr;
+			message = {};
+			message.msg_name = &table.targets[target];
+			message.msg_namelen = sizeof(sockaddr_in);
+			message.msg_iov = &table.payloads[set];
+			message.msg_iovlen = 1;
+		}
+	}
+#endif
+
+	return true;
+}
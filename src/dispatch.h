@@ -0,0 +1,222 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <WinSock2.h>
+#else
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "output.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// Q2PRO drops console lines longer than MAX_STRING_CHARS, which includes the rcon header.
+// Datagrams of the other output formats are limited to the same size.
+#define MAX_RCON_MESSAGE 1024
+
+// A pre-rendered datagram in PacketSet::arena with a single update: header, update and terminator
+struct PacketRef
+{
+	uint32_t offset;
+	uint32_t length;
+};
+
+// Updates issued between BeginBatch() and EndBatch() are joined into as few datagrams
+// as the maximum message length allows
+struct PacketBatch
+{
+	char message[MAX_RCON_MESSAGE];
+	int length = 0; // without the terminator
+	int count = 0;  // updates in the message, 0 while nothing has been added
+};
+
+// Every packet that the mapped channels can produce, rendered in one output format with one
+// password and shared by all targets that use them. Packet indices are the same in all sets.
+struct PacketSet
+{
+	OutputFormat format = OutputFormat::Rcon;
+	const OutputEncoder* encoder = nullptr;
+	std::string password;
+	std::vector<char> arena;
+	std::vector<PacketRef> packets;
+	int header_length = 0; // the encoder's header, stored at the start of the arena
+	uint32_t sequence = 0; // passed to OutputEncoder::Finish, increments with every datagram
+
+	// UDP targets of a set are contiguous in DispatchTable::targets; a text output has none and
+	// writes to a file instead, which is shared with the next table when the config is reloaded
+	int first_target = 0;
+	int target_count = 0;
+	std::string file_name;
+	std::shared_ptr<FILE> file;
+
+	PacketBatch batch;
+
+	// datagram that SendToTargets() delivers
+	const char* payload = nullptr;
+	int payload_length = 0;
+};
+
+// What to do with a MIDI channel, compiled from KorgiConfig by CompileDispatchTable()
+// so that handling an event is a single indexed load
+struct ChannelAction
+{
+	enum class Type
+	{
+		None,
+		Button,
+		Knob,
+		Bank, // selects another bank of actions when pressed
+	};
+
+	// relative values of 'bank'
+	enum
+	{
+		PreviousBank = -1,
+		NextBank = -2,
+	};
+
+	Type type = Type::None;
+	const char* command = nullptr;   // button command or knob variable name, in DispatchTable::names
+	int first_packet = -1;           // index in PacketSet::packets, knobs have one packet per MIDI value
+	float scale = 0.f;               // knob variable value = bias + scale * MIDI value
+	float bias = 0.f;
+	Clock::duration interval = {};   // minimum time between two knob updates
+	int deadband = 0;                // MIDI steps ignored when a knob reverses its direction
+	float smoothing = 0.f;           // time constant of the interpolation in seconds, 0 sends MIDI values as they are
+	int knob = -1;                   // index in DispatchTable::knob_values, the same in all banks that share the mapping
+	int bank = 0;                    // bank to select, or PreviousBank or NextBank
+};
+
+// Everything the event path needs, including every packet that a mapped channel can produce.
+// A new table is built for each config load and swapped in, so sending never formats text.
+// Every bank has its own complete set of channel actions, and selecting a bank only moves 'channels'.
+struct DispatchTable
+{
+	std::vector<ChannelAction> actions;      // control_count per bank
+	const ChannelAction* channels = nullptr; // actions of the selected bank, indexed by GetControlIndex()
+	int control_count = 0;                   // MIDI_CHANNEL_COUNT per device
+	int bank = 0;                            // selected bank
+	std::vector<std::string> bank_names;     // one per bank, a single empty name if the config has no banks
+	std::vector<int> knob_values;  // last MIDI value accepted for each knob mapping, -1 if none, for resync snapshots
+	std::vector<int> knob_actions; // index in 'actions' of each knob mapping, -1 if no bank uses it
+	std::vector<char> names;
+	std::vector<int> packet_outputs; // for every packet, the first one of its knob with the same command
+	std::vector<PacketSet> packet_sets;
+	std::vector<sockaddr_in> targets;
+	Clock::duration smoothing_tick = {}; // interval between interpolated updates of smoothed knobs
+	Clock::duration resync_interval = {}; // between two snapshots of all knob values, 0 to disable
+	Clock::duration resync_idle = {};     // idle time after which a snapshot is sent, 0 to disable
+#ifndef _WIN32
+	std::vector<iovec> payloads;   // one per packet set, shared by the messages of all its targets
+	std::vector<mmsghdr> messages; // one per target
+#endif
+};
+
+// Times of a MIDI event on its way to the network, only recorded when tracing
+struct EventTimes
+{
+	Clock::time_point dequeued;
+	Clock::time_point dispatched;
+};
+
+extern std::unique_ptr<DispatchTable> g_dispatch;
+
+bool OpenSocket();
+void CloseSocket();
+
+#ifndef _WIN32
+// The socket that sends to all targets, readable when they have sent something back
+int GetSocketDescriptor();
+
+// Reads everything that the targets have sent back without blocking, rcon replies are logged
+void ReceiveReplies();
+
+// Sends UDP packets through io_uring instead of sendmmsg, see uring_sender.h. Returns false if
+// io_uring is unavailable, and sendmmsg keeps being used.
+bool OpenUringTransport(int bufferCount);
+void CloseUringTransport();
+#endif
+
+// Builds the dispatch table, resolves the targets and renders all packets for 'config'.
+// Buttons take precedence over knobs mapped to the same channel.
+bool CompileDispatchTable(const KorgiConfig& config, DispatchTable& table);
+
+// Controls of all devices are numbered in one range
+inline int GetControlIndex(int device, int midiChannel)
+{
+	return device * MIDI_CHANNEL_COUNT + midiChannel;
+}
+
+float GetKnobValue(const ChannelAction& knob, int midiValue);
+
+// Sends a pre-rendered packet to all targets, or joins its command to the current batch
+void SendPacket(int index);
+
+// Renders and sends a knob value that has no pre-rendered packet, such as an interpolated one.
+// Returns false if the command is too long for an rcon packet.
+bool SendKnobValue(int control, const ChannelAction& knob, float value);
+
+// Everything sent between BeginBatch() and EndBatch() goes out in as few packets as possible
+void BeginBatch();
+void EndBatch();
+
+// Sends the knobs whose coalescing interval has elapsed, or all pending knobs if 'force' is set,
+// the interpolated values of smoothed knobs and resync snapshots.
+// Returns the time when the next of these becomes due, or Clock::time_point::max() if none.
+Clock::time_point FlushPendingKnobs(Clock::time_point now, bool force);
+
+// Makes 'bank' the bank that MIDI events are dispatched with. Pending knob values of the
+// previous bank are sent first.
+void SelectBank(DispatchTable& table, int bank);
+
+// 'device' is the index of the device in KorgiConfig::devices, events from unknown devices are dropped
+void HandleMidiInput(int device, unsigned char midiChannel, unsigned char midiValue);
+
+// Forgets the last values sent for all knobs, so that the next update of each one goes out
+void ResetKnobFilters();
+
+// Resync snapshots sent so far
+uint64_t GetResyncSnapshotCount();
+
+// Knob updates dropped because they would not have changed the output or were within the deadband
+uint64_t GetSuppressedUpdateCount();
+
+int64_t ToNanoseconds(Clock::duration duration);
+
+// Starts tracing the event that is about to be passed to HandleMidiInput
+void TraceDequeue(Clock::time_point dequeued);
@@ -0,0 +1,138 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "event_loop.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <type_traits>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+// Clock is read with clock_gettime(CLOCK_MONOTONIC), so its time points can be passed to the timer as they are
+static_assert(std::is_same<Clock, std::chrono::steady_clock>::value, "the timer runs on CLOCK_MONOTONIC");
+
+bool EventLoop::Open(const sigset_t& signals)
+{
+	Close();
+
+	m_epoll = epoll_create1(EPOLL_CLOEXEC);
+	m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	m_signal = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	if (m_epoll < 0 || m_timer < 0 || m_signal < 0)
+	{
+		fprintf(stderr, "error: failed to create the event loop: %s\n", strerror(errno));
+		Close();
+		return false;
+	}
+
+	return Add(m_timer, TimerTag) && Add(m_signal, SignalTag);
+}
+
+void EventLoop::Close()
+{
+	for (int* fd : { &m_epoll, &m_timer, &m_signal })
+	{
+		if (*fd >= 0)
+			close(*fd);
+		*fd = -1;
+	}
+
+	m_deadline = Clock::time_point::max();
+}
+
+bool EventLoop::Add(int fd, int tag)
+{
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.u64 = uint64_t(uint32_t(tag));
+
+	if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) < 0)
+	{
+		fprintf(stderr, "error: failed to add descriptor %d to the event loop: %s\n", fd, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+void EventLoop::SetDeadline(Clock::time_point deadline)
+{
+	if (deadline == m_deadline)
+		return;
+
+	m_deadline = deadline;
+
+	// a zero it_value disarms the timer, and a deadline in the past expires right away
+	itimerspec spec = {};
+	if (deadline != Clock::time_point::max())
+	{
+		int64_t ns = std::max<int64_t>(1, ToNanoseconds(deadline.time_since_epoch()));
+		spec.it_value.tv_sec = time_t(ns / 1000000000);
+		spec.it_value.tv_nsec = long(ns % 1000000000);
+	}
+
+	if (timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &spec, nullptr) < 0)
+		fprintf(stderr, "\nwarning: failed to arm the timer: %s\n", strerror(errno));
+}
+
+int EventLoop::Wait(int* tags, int maxCount, int timeoutMs)
+{
+	epoll_event events[16];
+	int count = epoll_wait(m_epoll, events, std::min(maxCount, 16), timeoutMs);
+	if (count < 0)
+		return 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		tags[i] = int(uint32_t(events[i].data.u64));
+
+		// the timer is one-shot, reading it resets its readability
+		if (tags[i] == TimerTag)
+		{
+			uint64_t expirations;
+			if (read(m_timer, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+				fprintf(stderr, "\nwarning: failed to read the timer: %s\n", strerror(errno));
+			m_deadline = Clock::time_point::max();
+		}
+	}
+
+	return count;
+}
+
+int EventLoop::ReadSignal()
+{
+	signalfd_siginfo info;
+	if (read(m_signal, &info, sizeof(info)) != sizeof(info))
+		return 0;
+
+	return int(info.ssi_signo);
+}
+
+#endif
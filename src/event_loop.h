@@ -0,0 +1,70 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <signal.h>
+
+#include "dispatch.h"
+
+// The reactor of the main loop on Linux: one epoll set for all descriptors, a timerfd that
+// wakes the loop up for timed work, and a signalfd through which signals arrive as events.
+// The signals must be blocked in all threads before Open() is called.
+class EventLoop
+{
+public:
+	// Tags that Wait() reports for the timer and the signals, the others belong to the caller
+	enum
+	{
+		TimerTag = -1,
+		SignalTag = -2,
+	};
+
+	~EventLoop() { Close(); }
+
+	bool Open(const sigset_t& signals);
+	void Close();
+
+	// Watches 'fd' for readability, 'tag' identifies it in the results of Wait()
+	bool Add(int fd, int tag);
+
+	// Arms the timer for 'deadline' on Clock, or disarms it for Clock::time_point::max().
+	// The timer is only reprogrammed when the deadline changes.
+	void SetDeadline(Clock::time_point deadline);
+
+	// Waits until descriptors are readable or 'timeoutMs' has passed, -1 waits until the timer expires.
+	// Stores the tags of the ready descriptors and returns their number, or 0 if interrupted.
+	int Wait(int* tags, int maxCount, int timeoutMs);
+
+	// Returns the next pending signal, or 0 if there are none. Call when SignalTag is ready.
+	int ReadSignal();
+
+private:
+	int m_epoll = -1;
+	int m_timer = -1;
+	int m_signal = -1;
+	Clock::time_point m_deadline = Clock::time_point::max();
+};
+
+#endif
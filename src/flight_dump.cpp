@@ -0,0 +1,211 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// korgi_dump: prints the records of a flight recorder file, oldest first. The file may belong to
+// a running korgi; with 'follow', new records are printed as they are written.
+// Usage: korgi_dump <file> [follow]
+
+#define _CRT_SECURE_NO_WARNINGS
+#define NOMINMAX
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "flight_recorder.h"
+
+// How often 'follow' looks for new records
+#define FOLLOW_INTERVAL_MS 100
+
+static const void* MapFile(const char* fileName, size_t& size)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	LARGE_INTEGER fileSize = {};
+	GetFileSizeEx(file, &fileSize);
+	size = size_t(fileSize.QuadPart);
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+	// the view keeps the mapping and the file open
+	if (mapping)
+		CloseHandle(mapping);
+	CloseHandle(file);
+	return view;
+#else
+	int fd = open(fileName, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return nullptr;
+
+	struct stat status = {};
+	fstat(fd, &status);
+	size = size_t(status.st_size);
+
+	void* view = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	return view == MAP_FAILED ? nullptr : view;
+#endif
+}
+
+static void SleepMs(int ms)
+{
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	usleep(ms * 1000);
+#endif
+}
+
+static void PrintRecord(const FlightHeader& header, const FlightRecord& record, int64_t& previousNs)
+{
+	// the records are stamped with the monotonic clock, the header relates it to the wall clock
+	int64_t wallNs = header.wall_ns + (record.time_ns - header.clock_ns);
+	time_t seconds = time_t(wallNs / 1000000000);
+	char wallTime[32] = "?";
+	if (const tm* local = localtime(&seconds))
+		strftime(wallTime, sizeof(wallTime), "%Y-%m-%d %H:%M:%S", local);
+
+	double deltaUs = previousNs ? double(record.time_ns - previousNs) / 1000.0 : 0.0;
+	previousNs = record.time_ns;
+
+	printf("%s.%06d %+12.1f us  ", wallTime, int(wallNs % 1000000000 / 1000), deltaUs);
+
+	switch (record.type)
+	{
+	case FlightRecordType::Event:
+		printf("event   device %d channel %d value %d\n", record.device, record.channel, record.value);
+		break;
+	case FlightRecordType::Send:
+		printf("send    %u bytes to %u target%s\n", record.length, record.count, record.count == 1 ? "" : "s");
+		break;
+	case FlightRecordType::Reload:
+		printf("reload  %s\n", record.value ? "applied" : "failed, kept the previous config");
+		break;
+	default:
+		printf("unknown record type %d\n", int(record.type));
+		break;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: korgi_dump <file> [follow]\n");
+		return 1;
+	}
+
+	bool follow = argc > 2 && strcmp(argv[2], "follow") == 0;
+
+	size_t size = 0;
+	const char* data = (const char*)MapFile(argv[1], size);
+	if (!data)
+	{
+		fprintf(stderr, "error: couldn't map %s\n", argv[1]);
+		return 1;
+	}
+
+	const FlightHeader& header = *(const FlightHeader*)data;
+	const FlightRecord* records = (const FlightRecord*)(data + sizeof(FlightHeader));
+
+	if (size < sizeof(FlightHeader) || header.magic != FLIGHT_MAGIC || header.version != FLIGHT_VERSION
+		|| header.record_size != sizeof(FlightRecord) || size < sizeof(FlightHeader) + uint64_t(header.record_count) * sizeof(FlightRecord))
+	{
+		fprintf(stderr, "error: %s is not a flight recorder file\n", argv[1]);
+		return 1;
+	}
+
+	uint64_t recordCount = header.record_count;
+	int64_t startNs = header.clock_ns;
+	int64_t previousNs = 0;
+	uint64_t lost = 0;
+
+	uint64_t written = header.sequence.load(std::memory_order_acquire);
+	uint64_t next = written > recordCount ? written - recordCount : 0;
+
+	for (;;)
+	{
+		for (; next < written; next++)
+		{
+			FlightRecord copy;
+			if (!ReadFlightRecord(records[next % recordCount], next, copy))
+			{
+				// overwritten while this was catching up, skip to the oldest record still there
+				written = header.sequence.load(std::memory_order_acquire);
+				uint64_t oldest = written >= recordCount ? written - recordCount + 1 : 0;
+				if (oldest <= next)
+					oldest = next + 1;
+
+				lost += oldest - next;
+				next = oldest - 1;
+				continue;
+			}
+
+			PrintRecord(header, copy, previousNs);
+		}
+
+		if (!follow)
+			break;
+
+		fflush(stdout);
+		SleepMs(FOLLOW_INTERVAL_MS);
+
+		// a new korgi starts over with the file
+		if (header.clock_ns != startNs || header.sequence.load(std::memory_order_acquire) < next)
+		{
+			while (header.magic != FLIGHT_MAGIC)
+				SleepMs(FOLLOW_INTERVAL_MS);
+
+			// the records would be at other places, and possibly beyond the mapping
+			if (header.record_count != recordCount)
+			{
+				printf("korgi_dump: korgi restarted with %u records instead of %llu, run korgi_dump again\n", header.record_count, (unsigned long long)recordCount);
+				break;
+			}
+
+			printf("korgi_dump: korgi restarted\n");
+			startNs = header.clock_ns;
+			previousNs = 0;
+			next = 0;
+		}
+
+		written = header.sequence.load(std::memory_order_acquire);
+	}
+
+	if (lost)
+		printf("korgi_dump: %llu records were overwritten before they could be read\n", (unsigned long long)lost);
+
+	return 0;
+}
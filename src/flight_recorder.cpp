@@ -0,0 +1,227 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "flight_recorder.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+#define MAX_FLIGHT_RECORDS (16 * 1024 * 1024)
+
+static FlightHeader* g_flightHeader = nullptr;
+static FlightRecord* g_flightRecords = nullptr;
+static uint64_t g_flightMask = 0;
+static size_t g_flightMappingSize = 0;
+
+#ifdef _WIN32
+static HANDLE g_flightFile = INVALID_HANDLE_VALUE;
+static HANDLE g_flightMapping = nullptr;
+#endif
+
+static int64_t GetClockNs()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Creates the file or resizes an existing one, and maps it for writing
+static void* MapFlightFile(const string& fileName, size_t size)
+{
+#ifdef _WIN32
+	// other processes may read the file while it is written
+	g_flightFile = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (g_flightFile == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "error: couldn't create %s\n", fileName.c_str());
+		return nullptr;
+	}
+
+	g_flightMapping = CreateFileMappingA(g_flightFile, nullptr, PAGE_READWRITE, DWORD(uint64_t(size) >> 32), DWORD(size), nullptr);
+	void* mapping = g_flightMapping ? MapViewOfFile(g_flightMapping, FILE_MAP_WRITE, 0, 0, size) : nullptr;
+	if (!mapping)
+		fprintf(stderr, "error: couldn't map %s\n", fileName.c_str());
+
+	return mapping;
+#else
+	int fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		fprintf(stderr, "error: couldn't create %s: %s\n", fileName.c_str(), strerror(errno));
+		return nullptr;
+	}
+
+	// A file is grown but never shrunk, a reader that has it mapped would crash with SIGBUS.
+	// A smaller ring only uses the start of the file.
+	struct stat status = {};
+	bool grow = fstat(fd, &status) == 0 && status.st_size < off_t(size);
+
+	void* mapping = MAP_FAILED;
+	if (!grow || ftruncate(fd, off_t(size)) == 0)
+		mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (mapping == MAP_FAILED)
+		fprintf(stderr, "error: couldn't map %s: %s\n", fileName.c_str(), strerror(errno));
+
+	// the mapping keeps the file open
+	close(fd);
+	return mapping == MAP_FAILED ? nullptr : mapping;
+#endif
+}
+
+bool OpenFlightRecorder(const string& fileName, int recordCount)
+{
+	CloseFlightRecorder();
+
+	uint32_t count = 1;
+	while (count < uint32_t(recordCount) && count < MAX_FLIGHT_RECORDS)
+		count *= 2;
+
+	size_t size = sizeof(FlightHeader) + size_t(count) * sizeof(FlightRecord);
+	void* mapping = MapFlightFile(fileName, size);
+	if (!mapping)
+	{
+		CloseFlightRecorder();
+		return false;
+	}
+
+	// Clearing the previous recording also faults all pages in, so that writing a record never
+	// waits for the kernel.
+	memset(mapping, 0, size);
+
+	g_flightHeader = new (mapping) FlightHeader();
+	g_flightHeader->record_size = sizeof(FlightRecord);
+	g_flightHeader->record_count = count;
+	g_flightHeader->clock_ns = GetClockNs();
+	g_flightHeader->wall_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+	g_flightHeader->version = FLIGHT_VERSION;
+
+	// the magic goes last, readers ignore the file until the header is complete
+	atomic_thread_fence(memory_order_release);
+	g_flightHeader->magic = FLIGHT_MAGIC;
+
+	g_flightRecords = reinterpret_cast<FlightRecord*>(g_flightHeader + 1);
+	g_flightMask = count - 1;
+	g_flightMappingSize = size;
+
+	return true;
+}
+
+void CloseFlightRecorder()
+{
+#ifdef _WIN32
+	if (g_flightHeader)
+		UnmapViewOfFile(g_flightHeader);
+	if (g_flightMapping)
+		CloseHandle(g_flightMapping);
+	if (g_flightFile != INVALID_HANDLE_VALUE)
+		CloseHandle(g_flightFile);
+
+	g_flightMapping = nullptr;
+	g_flightFile = INVALID_HANDLE_VALUE;
+#else
+	if (g_flightHeader)
+		munmap(g_flightHeader, g_flightMappingSize);
+#endif
+
+	g_flightHeader = nullptr;
+	g_flightRecords = nullptr;
+	g_flightMappingSize = 0;
+}
+
+// Claims the next record and clears its stamp, the caller fills it in and publishes it
+static FlightRecord* BeginFlightRecord(FlightRecordType type)
+{
+	if (!g_flightRecords)
+		return nullptr;
+
+	uint64_t sequence = g_flightHeader->sequence.load(memory_order_relaxed);
+	FlightRecord* record = &g_flightRecords[sequence & g_flightMask];
+
+	record->stamp.store(0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	record->time_ns = GetClockNs();
+	record->type = type;
+	return record;
+}
+
+static void EndFlightRecord(FlightRecord* record)
+{
+	uint64_t sequence = g_flightHeader->sequence.load(memory_order_relaxed);
+	record->stamp.store(sequence + 1, memory_order_release);
+	g_flightHeader->sequence.store(sequence + 1, memory_order_release);
+}
+
+void RecordFlightEvent(int device, unsigned char channel, unsigned char value)
+{
+	if (FlightRecord* record = BeginFlightRecord(FlightRecordType::Event))
+	{
+		record->device = uint8_t(device);
+		record->channel = channel;
+		record->value = value;
+		record->length = 0;
+		record->count = 0;
+		EndFlightRecord(record);
+	}
+}
+
+void RecordFlightSend(int length, int targetCount)
+{
+	if (FlightRecord* record = BeginFlightRecord(FlightRecordType::Send))
+	{
+		record->device = 0;
+		record->channel = 0;
+		record->value = 0;
+		record->length = uint32_t(length);
+		record->count = uint32_t(targetCount);
+		EndFlightRecord(record);
+	}
+}
+
+void RecordFlightReload(bool applied)
+{
+	if (FlightRecord* record = BeginFlightRecord(FlightRecordType::Reload))
+	{
+		record->device = 0;
+		record->channel = 0;
+		record->value = applied ? 1 : 0;
+		record->length = 0;
+		record->count = 0;
+		EndFlightRecord(record);
+	}
+}
@@ -0,0 +1,112 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// Flight recorder: a fixed-size ring of the latest events, sends and config reloads in a
+// memory-mapped file, for finding out what happened after the fact. The file is a 64-byte
+// header followed by a power of two of 32-byte records, all in host byte order:
+//
+//   header: uint32 magic "KRGF", uint16 version, uint16 record size, uint32 record count,
+//           uint32 reserved, uint64 records written since korgi started,
+//           int64 monotonic and int64 wall clock time at startup in nanoseconds, 24 reserved bytes
+//   record: uint64 stamp, int64 monotonic time in nanoseconds, uint8 type, uint8 device,
+//           uint8 MIDI channel, uint8 MIDI value, uint32 payload length, uint32 target count,
+//           uint32 reserved
+//
+// Record n (counting from 0) is stored at index n % record count and has the stamp n + 1.
+// The stamp is cleared while the record is written, so a reader of a live file copies the
+// record between two loads of the stamp and discards it unless both match.
+
+#define FLIGHT_MAGIC 0x4647524b // "KRGF"
+#define FLIGHT_VERSION 1
+
+enum class FlightRecordType : uint8_t
+{
+	Event = 1,  // a MIDI event was dispatched: device, channel and value
+	Send = 2,   // a payload was sent: length and target count
+	Reload = 3, // the config file was reloaded, value is 1 if it was applied
+};
+
+struct FlightHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t record_count;
+	uint32_t reserved;
+	std::atomic<uint64_t> sequence;
+	int64_t clock_ns;
+	int64_t wall_ns;
+	uint8_t reserved2[24];
+};
+
+struct FlightRecord
+{
+	std::atomic<uint64_t> stamp;
+	int64_t time_ns;
+	FlightRecordType type;
+	uint8_t device;
+	uint8_t channel;
+	uint8_t value;
+	uint32_t length;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(FlightHeader) == 64, "FlightHeader must match the file format");
+static_assert(sizeof(FlightRecord) == 32, "FlightRecord must match the file format");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the stamps are shared with other processes");
+
+// Copies record 'sequence' out of a live ring. Returns false if it has been overwritten
+// or is being written.
+inline bool ReadFlightRecord(const FlightRecord& record, uint64_t sequence, FlightRecord& copy)
+{
+	if (record.stamp.load(std::memory_order_acquire) != sequence + 1)
+		return false;
+
+	copy.time_ns = record.time_ns;
+	copy.type = record.type;
+	copy.device = record.device;
+	copy.channel = record.channel;
+	copy.value = record.value;
+	copy.length = record.length;
+	copy.count = record.count;
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return record.stamp.load(std::memory_order_relaxed) == sequence + 1;
+}
+
+// Maps 'fileName' with room for 'recordCount' records, rounded up to a power of two, and
+// starts a new recording. The file survives a crash of korgi with everything written so far.
+bool OpenFlightRecorder(const std::string& fileName, int recordCount);
+void CloseFlightRecorder();
+
+// Each of these is a handful of stores into the mapping, without system calls. The calls
+// must not overlap, korgi makes them from the thread that dispatches events.
+void RecordFlightEvent(int device, unsigned char channel, unsigned char value);
+void RecordFlightSend(int length, int targetCount);
+void RecordFlightReload(bool applied);
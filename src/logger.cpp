@@ -0,0 +1,263 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <system_error>
+#include <thread>
+
+#include "config.h"
+
+// Must be a power of two
+#define LOG_RING_SIZE 1024
+
+struct LogRecord
+{
+	enum class Type
+	{
+		Button,
+		Knob,
+		Unmapped,
+		Reply,
+	};
+
+	Type type;
+	int control; // device * MIDI_CHANNEL_COUNT + channel, -1 for replies
+	int value;
+	float fvalue;
+	char text[64];
+};
+
+static LogRecord g_ring[LOG_RING_SIZE];
+alignas(64) static std::atomic<unsigned> g_head(0); // next record to write, owned by the producer
+alignas(64) static std::atomic<unsigned> g_tail(0); // next record to print, owned by the logger thread
+static std::atomic<unsigned> g_dropped(0);
+
+static std::atomic<LogMode> g_mode(LogMode::Status);
+static std::atomic<int> g_statusIntervalMs(50);
+static std::atomic<bool> g_stop(false);
+static std::thread g_thread;
+
+static LogRecord* BeginRecord()
+{
+	if (g_mode.load(std::memory_order_relaxed) == LogMode::Quiet)
+		return nullptr;
+
+	unsigned head = g_head.load(std::memory_order_relaxed);
+	if (head - g_tail.load(std::memory_order_acquire) >= LOG_RING_SIZE)
+	{
+		g_dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	return &g_ring[head & (LOG_RING_SIZE - 1)];
+}
+
+static void CommitRecord()
+{
+	g_head.store(g_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void LogButton(int control, const char *command)
+{
+	LogRecord *record = BeginRecord();
+	if (!record)
+		return;
+
+	record->type = LogRecord::Type::Button;
+	record->control = control;
+	strncpy(record->text, command, sizeof(record->text) - 1);
+	record->text[sizeof(record->text) - 1] = 0;
+	CommitRecord();
+}
+
+void LogKnob(int control, const char *name, float value)
+{
+	LogRecord *record = BeginRecord();
+	if (!record)
+		return;
+
+	record->type = LogRecord::Type::Knob;
+	record->control = control;
+	record->fvalue = value;
+	strncpy(record->text, name, sizeof(record->text) - 1);
+	record->text[sizeof(record->text) - 1] = 0;
+	CommitRecord();
+}
+
+void LogUnmapped(int control, int value)
+{
+	LogRecord *record = BeginRecord();
+	if (!record)
+		return;
+
+	record->type = LogRecord::Type::Unmapped;
+	record->control = control;
+	record->value = value;
+	CommitRecord();
+}
+
+void LogReply(const char *text)
+{
+	LogRecord *record = BeginRecord();
+	if (!record)
+		return;
+
+	record->type = LogRecord::Type::Reply;
+	record->control = -1;
+	strncpy(record->text, text, sizeof(record->text) - 1);
+	record->text[sizeof(record->text) - 1] = 0;
+	CommitRecord();
+}
+
+static void PrintRecord(const LogRecord& record, int& previousControl)
+{
+	// replies are never overwritten, and the next control starts a new line
+	if (record.type == LogRecord::Type::Reply)
+	{
+		printf("\nkorgi: reply \"%s\"", record.text);
+		previousControl = -1;
+		return;
+	}
+
+	// consecutive events on the same control overwrite each other
+	if (previousControl == record.control)
+		printf("\r");
+	else
+		printf("\n");
+	previousControl = record.control;
+
+	// controls of the first device are shown by channel, the others as device:channel
+	char control[16];
+	if (record.control < MIDI_CHANNEL_COUNT)
+		snprintf(control, sizeof(control), "%d", record.control);
+	else
+		snprintf(control, sizeof(control), "%d:%d", record.control / MIDI_CHANNEL_COUNT, record.control % MIDI_CHANNEL_COUNT);
+
+	switch (record.type)
+	{
+	case LogRecord::Type::Button:
+		printf("korgi: button %s \"%s\"", control, record.text);
+		break;
+	case LogRecord::Type::Knob:
+		printf("korgi: knob %s \"%s %.3f\"   ", control, record.text, record.fvalue);
+		break;
+	case LogRecord::Type::Unmapped:
+		printf("korgi: channel %s unmapped value %d   ", control, record.value);
+		break;
+	case LogRecord::Type::Reply:
+		break; // printed on a line of its own above
+	}
+}
+
+static void LoggerThread()
+{
+	int previousControl = -1;
+
+	for (;;)
+	{
+		bool stopping = g_stop.load();
+		LogMode mode = g_mode.load(std::memory_order_relaxed);
+
+		unsigned tail = g_tail.load(std::memory_order_relaxed);
+		unsigned head = g_head.load(std::memory_order_acquire);
+		bool printed = false;
+
+		for (; tail != head; tail++)
+		{
+			const LogRecord& record = g_ring[tail & (LOG_RING_SIZE - 1)];
+
+			// the status line only shows the last value of a run of events on one control
+			if (mode == LogMode::Status && record.type != LogRecord::Type::Reply && tail + 1 != head && g_ring[(tail + 1) & (LOG_RING_SIZE - 1)].control == record.control)
+				continue;
+
+			if (mode != LogMode::Quiet)
+			{
+				PrintRecord(record, previousControl);
+				printed = true;
+			}
+		}
+
+		g_tail.store(tail, std::memory_order_release);
+
+		unsigned dropped = g_dropped.exchange(0, std::memory_order_relaxed);
+		if (dropped && mode == LogMode::Full)
+		{
+			printf("\nkorgi: output too slow, %u messages dropped", dropped);
+			previousControl = -1;
+			printed = true;
+		}
+
+		if (printed)
+			fflush(stdout);
+
+		if (stopping)
+			break;
+
+		int intervalMs = 100;
+		if (mode == LogMode::Status)
+			intervalMs = g_statusIntervalMs.load(std::memory_order_relaxed);
+		else if (mode == LogMode::Full)
+			intervalMs = 10;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+	}
+}
+
+bool StartLogger()
+{
+	g_stop = false;
+
+	try
+	{
+		g_thread = std::thread(LoggerThread);
+	}
+	catch (const std::system_error&)
+	{
+		fprintf(stderr, "error: failed to start the logger thread\n");
+		return false;
+	}
+
+	return true;
+}
+
+void StopLogger()
+{
+	if (!g_thread.joinable())
+		return;
+
+	g_stop = true;
+	g_thread.join();
+}
+
+void SetLogMode(LogMode mode, float statusRate)
+{
+	g_mode = mode;
+
+	if (statusRate > 0.f)
+		g_statusIntervalMs = std::max(1, int(1000.f / statusRate));
+}
@@ -0,0 +1,46 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// Console output of the MIDI event path. Records are pushed into a lock-free ring buffer
+// and printed by a background thread, so the send path never waits for stdout.
+// Only one thread may push records at a time.
+
+enum class LogMode
+{
+	Quiet,  // nothing is printed
+	Status, // one status line per control, overwritten with '\r' at a limited rate
+	Full,   // every event is printed
+};
+
+bool StartLogger();
+void StopLogger();
+void SetLogMode(LogMode mode, float statusRate);
+
+// 'control' is the channel number for the first device, see GetControlIndex()
+void LogButton(int control, const char *command);
+void LogKnob(int control, const char *name, float value);
+void LogUnmapped(int control, int value);
+
+// A line of text that a server sent back, such as the reply to an rcon command
+void LogReply(const char *text);
@@ -24,161 +24,162 @@
 #define NOMINMAX
 
 #include <stdio.h>
+#include <string.h>
 #include <thread>
+#include <chrono>
 
 #ifdef _WIN32
 #include <WinSock2.h>
 #include <mmsystem.h>
-#include <WS2tcpip.h>
 #else
 #include <alsa/asoundlib.h>
 #include <poll.h>
-#include <arpa/inet.h>
-#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <errno.h>
 #endif
 
-#include <unordered_map>
 #include <algorithm>
 #include <signal.h>
 #include <string>
+#include <mutex>
+#include <system_error>
+#include <vector>
+#include <stdint.h>
 
 #ifdef _WIN32
 #pragma comment(lib, "winmm")
 #pragma comment(lib, "ws2_32")
 #endif
 
+#include "config.h"
+#include "dispatch.h"
+#include "event_loop.h"
+#include "flight_recorder.h"
+#include "logger.h"
+#include "metrics.h"
+#include "midi_parser.h"
+#include "midi_trace.h"
+#include "pipeline.h"
+#include "trace.h"
+
 using namespace std;
 
+// MIDI devices are opened in the order of KorgiConfig::devices, whose index identifies them
+int g_midiDeviceCount = 0;
+
 #ifdef _WIN32
-WSADATA g_wsaData = {};
-SOCKET g_SendSocket = 0;
-sockaddr_in g_sendToAddr = {};
-HMIDIIN g_midiInHandle = {};
+HMIDIIN g_midiInHandles[MAX_MIDI_DEVICES] = {};
 #else
-int g_SendSocket = 0;
-struct sockaddr_in g_sendToAddr = {};
+// a single sequencer client receives from all devices, events are told apart by their source
 snd_seq_t *g_midiInHandle = NULL;
-snd_seq_port_subscribe_t *g_midiSubscription = NULL;
+snd_seq_port_subscribe_t *g_midiSubscriptions[MAX_MIDI_DEVICES] = {};
+snd_seq_addr_t g_midiSources[MAX_MIDI_DEVICES] = {};
 int g_midiPort = 0;
+int g_midiQueue = -1;
 struct pollfd *g_pollFds = NULL;
 int g_pollFdCount = 0;
 
-// Function shims
-#define InetPton inet_pton
-#define strcpy_s strcpy
-#define sprintf_s sprintf
-#endif
-
-#include "control_surface_map.h"
-
-bool g_terminate = false;
-
-struct KnobMapping
+// Devices with 'raw_midi' are read directly and decoded by korgi, bypassing the sequencer
+struct RawMidiInput
 {
 	std::string name;
-	float min_value;
-	float max_value;
+	snd_rawmidi_t *rawmidi = NULL; // NULL if 'fd' was opened as a file
+	int fd = -1; // -1 once the input has ended
+	int device = 0;
+	MidiParser parser;
 };
 
-struct KorgiConfig
-{
-	string address = "127.0.0.1";
-	int port = 27910;
-	string password;
-	int device = 0;
-	string device_name = "nanoKONTROL2";
-	unordered_map<int, string> buttons;
-	unordered_map<int, KnobMapping> knobs;
-} g_config;
+RawMidiInput g_rawMidiInputs[MAX_MIDI_DEVICES];
+int g_rawMidiInputCount = 0;
+
+// In pipelined mode, the sequencer is read by its own thread, see pipeline.h
+PipelineMode g_pipelineMode = PipelineMode::Off;
+std::thread g_midiReader;
+int g_readerStopFd = -1;
+#endif
+
+volatile sig_atomic_t g_terminate = 0;
 
-bool OpenSocket()
-{
 #ifdef _WIN32
-	//Startup WinSock
-	if (0 != WSAStartup(MAKEWORD(2, 2), &g_wsaData))
-	{
-		fprintf(stderr, "error: failed to initialize WinSock\n");
-		return false;
-	}
+// MIDI callbacks arrive on a WinMM thread while pending knobs are flushed from Run()
+std::mutex g_dispatchMutex;
 #endif
 
-	// Setup broadcast socket
-	g_SendSocket = socket(AF_INET, SOCK_DGRAM, 0);
-	g_sendToAddr.sin_port = htons(g_config.port);
-	g_sendToAddr.sin_family = AF_INET;
-	if (0 == InetPton(AF_INET, g_config.address.c_str(), (void*)&g_sendToAddr.sin_addr.s_addr))
-	{
-		fprintf(stderr, "error: failed to translate the target IP address\n");
-		return false;
-	}
+MidiTraceWriter g_midiRecorder;
 
-	printf("korgi: connected to %s:%d\n", g_config.address.c_str(), g_config.port);
+// Replayed trace and its next event, which is due at g_replayStart + time / g_replaySpeed
+MidiTraceReader g_midiReplay;
+MidiTraceEvent g_replayEvent;
+bool g_replaying = false;
+float g_replaySpeed = 1.f;
+Clock::time_point g_replayStart;
+uint64_t g_replayCount = 0;
 
-	return true;
-}
+// Replaying as fast as possible still returns to the main loop after this many events
+#define REPLAY_CHUNK_SIZE 1024
 
-void CloseSocket()
+// How often a busy-polling sender checks for signals, config file changes and replies
+#define BUSY_EVENT_POLL_INTERVAL chrono::milliseconds(100)
+
+// All MIDI input backends deliver their events here. 'received' is when the event was read
+// from its input, so that queueing before the dispatch doesn't distort recorded traces.
+void ReceiveMidiEvent(int device, unsigned char midiChannel, unsigned char midiValue, Clock::time_point received)
 {
-#ifdef _WIN32
-	closesocket(g_SendSocket);
-	g_SendSocket = 0;
-	WSACleanup();
-#else
-	close(g_SendSocket);
-	g_SendSocket = 0;
-#endif
+	if (g_midiRecorder.IsOpen())
+		g_midiRecorder.Write(chrono::duration_cast<chrono::microseconds>(received.time_since_epoch()).count(), midiChannel, midiValue, device);
+
+	CountMetric(Metric::MidiEvents);
+	RecordFlightEvent(device, midiChannel, midiValue);
+	HandleMidiInput(device, midiChannel, midiValue);
 }
 
-void HandleMidiInput(unsigned char midiChannel, unsigned char midiValue)
+bool OpenReplay()
 {
-	static char previousChannel = -1;
-	if (previousChannel == midiChannel)
-		printf("\r");
-	else
-		printf("\n");
-	previousChannel = midiChannel;
+	if (!g_midiReplay.Open(g_config.replay_file))
+		return false;
+
+	g_replaying = g_midiReplay.Read(g_replayEvent);
+	g_replaySpeed = g_config.replay_speed;
+	g_replayStart = Clock::now();
 
-	char command[256];
-	command[0] = 0;
+	printf("korgi: replaying %s\n", g_config.replay_file.c_str());
 
-	const auto& button = g_config.buttons.find(midiChannel);
-	const auto& knob = g_config.knobs.find(midiChannel);
+	return true;
+}
 
-	if (button != g_config.buttons.end())
+// Dispatches the replayed events that are due and returns the time when the next one is
+Clock::time_point ReplayMidiEvents(Clock::time_point now)
+{
+	for (int count = 0; g_replaying && count < REPLAY_CHUNK_SIZE; count++)
 	{
-		if (midiValue > 0)
+		// events are recorded again at the time they were due, which keeps their spacing
+		Clock::time_point due = Clock::now();
+		if (g_replaySpeed > 0.f)
 		{
-			strcpy_s(command, button->second.c_str());
-
-			printf("korgi: button %u \"%s\"", midiChannel, button->second.c_str());
+			due = g_replayStart + chrono::microseconds(int64_t(double(g_replayEvent.time_us) / g_replaySpeed));
+			if (due > now)
+				return due;
 		}
-	}
-	else if (knob != g_config.knobs.end())
-	{
-		float fvalue = (float)midiValue / 127.f;
-		fvalue = max(0.f, min(1.f, fvalue));
 
-		float variable_value = knob->second.min_value * (1.f - fvalue) + knob->second.max_value * fvalue;
-		sprintf_s(command, "%s %.3f", knob->second.name.c_str(), variable_value);
+		if (g_config.trace)
+			TraceDequeue(Clock::now());
 
-		printf("korgi: knob %u \"%s\"   ", midiChannel, command);
-	}
-	else
-	{ 
-		printf("korgi: channel %u unmapped value %d   ", midiChannel, midiValue);
+		ReceiveMidiEvent(g_replayEvent.device, g_replayEvent.channel, g_replayEvent.value, due);
+		g_replayCount++;
+
+		g_replaying = g_midiReplay.Read(g_replayEvent);
 	}
 
-	if (*command)
-	{
-		char udp_message[256];
-		sprintf_s(udp_message, "\xff\xff\xff\xffrcon %s %s", g_config.password.c_str(), command);
+	if (g_replaying)
+		return now;
 
-		sendto(g_SendSocket, udp_message, int(strlen(udp_message)) + 1, 0, (sockaddr*)&g_sendToAddr, sizeof(g_sendToAddr));
-	}
+	printf("\nkorgi: replay finished after %llu events\n", (unsigned long long)g_replayCount);
+	g_terminate = 1;
 
-	// Don't want to buffer output since we want concolse output to match what's
-	// going across UDP pipe in terms of update-parity
-	fflush(0);
+	return Clock::time_point::max();
 }
 
 #ifdef _WIN32
@@ -187,15 +188,41 @@ void CALLBACK MidiInCallback(HMIDIIN  hMidiIn, UINT wMsg, DWORD_PTR dwInstance,
 	if (wMsg != MIM_DATA)
 		return;
 
-	char midiChannel = (dwParam1 >> 8) & 0xff;
-	char midiValue = (dwParam1 >> 16) & 0xff;
+	// a complete short message, with the running status already resolved by WinMM
+	MidiMessage message;
+	message.type = MidiMessageType((dwParam1 >> 4) & 0x0f);
+	message.channel = uint8_t(dwParam1 & 0x0f);
+	message.data1 = uint8_t((dwParam1 >> 8) & 0x7f);
+	message.data2 = uint8_t((dwParam1 >> 16) & 0x7f);
+	if (message.type == MidiMessageType::NoteOn && message.data2 == 0)
+		message.type = MidiMessageType::NoteOff;
+
+	unsigned char midiChannel, midiValue;
+	if (!GetMidiControl(message, midiChannel, midiValue))
+		return;
 
-	HandleMidiInput(midiChannel, midiValue);
+	// before waiting for the main loop to release the dispatcher
+	Clock::time_point received = Clock::now();
+
+	std::lock_guard<std::mutex> lock(g_dispatchMutex);
+
+	if (g_config.trace)
+	{
+		// dwParam2 is the time since midiInStart in milliseconds
+		Clock::time_point dequeued = Clock::now();
+		TraceDequeue(dequeued);
+		TraceSourceTime(int64_t(dwParam2) * 1000000, ToNanoseconds(dequeued.time_since_epoch()));
+	}
+
+	// the callback instance is the device index
+	ReceiveMidiEvent(int(dwInstance), midiChannel, midiValue, received);
 }
 #endif
 
 #ifdef __linux__
-unsigned char GetMidiDeviceMatchingName(const char *deviceName)
+// Client ID of the sequencer client called 'deviceName' that comes after 'skip' others with that
+// name, so that identical controllers can be told apart, or 0 if there is none
+unsigned char GetMidiDeviceMatchingName(const char *deviceName, int skip)
 {
 	int err;
 	snd_seq_client_info_t *client;
@@ -205,7 +232,7 @@ unsigned char GetMidiDeviceMatchingName(const char *deviceName)
 	while (!err)
 	{
 		const char *clientName = snd_seq_client_info_get_name(client);
-		if (!strcmp(clientName, deviceName))
+		if (!strcmp(clientName, deviceName) && skip-- == 0)
 		{
 			return snd_seq_client_info_get_client(client);
 		}
@@ -215,68 +242,222 @@ unsigned char GetMidiDeviceMatchingName(const char *deviceName)
 
 	return 0;
 }
-#endif
 
-bool OpenMidiDevice()
+// Index of the device that sent an event, or -1 if it isn't one of ours
+int GetMidiSourceDevice(const snd_seq_addr_t& source)
 {
-#ifdef _WIN32
-	if (midiInOpen(&g_midiInHandle, g_config.device, (DWORD_PTR)MidiInCallback, 0, CALLBACK_FUNCTION) != MMSYSERR_NOERROR)
+	for (int device = 0; device < g_midiDeviceCount; device++)
 	{
-		fprintf(stderr, "error: failed to open the midi device\n");
-		return false;
+		if (g_midiSubscriptions[device] && g_midiSources[device].client == source.client && g_midiSources[device].port == source.port)
+			return device;
 	}
 
-	midiInStart(g_midiInHandle);
+	return -1;
+}
+
+// Opens an ALSA raw MIDI device such as "hw:1,0,0", or a file such as /dev/snd/midiC1D0
+// or a FIFO if the name contains a slash
+bool OpenRawMidi(const std::string& name, int device)
+{
+	RawMidiInput& input = g_rawMidiInputs[g_rawMidiInputCount];
+	input = RawMidiInput();
+	input.name = name;
+	input.device = device;
+
+	if (name.find('/') != std::string::npos)
+	{
+		// a FIFO is opened for writing as well, so that it doesn't end when a writer goes away
+		struct stat status = {};
+		bool fifo = stat(name.c_str(), &status) == 0 && S_ISFIFO(status.st_mode);
 
-	MIDIINCAPS inCaps = {};
-	if (midiInGetDevCaps((UINT_PTR)&g_config.device, &inCaps, sizeof(MIDIINCAPS)) == MMSYSERR_NOERROR)
-		printf("korgi: opened midi device %d called \"%s\"\n", g_config.device, inCaps.szPname);
+		input.fd = open(name.c_str(), (fifo ? O_RDWR : O_RDONLY) | O_NONBLOCK | O_CLOEXEC);
+		if (input.fd < 0)
+		{
+			fprintf(stderr, "error: failed to open raw MIDI input '%s': %s\n", name.c_str(), strerror(errno));
+			return false;
+		}
+	}
 	else
-		printf("korgi: opened midi device %d but couldn't get its name...\n", g_config.device);
+	{
+		int err = snd_rawmidi_open(&input.rawmidi, NULL, name.c_str(), SND_RAWMIDI_NONBLOCK);
+		if (err < 0)
+		{
+			fprintf(stderr, "error: failed to open raw MIDI device '%s': %s\n", name.c_str(), snd_strerror(err));
+			input.rawmidi = NULL;
+			return false;
+		}
+
+		// raw MIDI input has a single descriptor
+		struct pollfd pollFd = {};
+		if (snd_rawmidi_poll_descriptors(input.rawmidi, &pollFd, 1) != 1)
+		{
+			fprintf(stderr, "error: failed to get the descriptor of raw MIDI device '%s'\n", name.c_str());
+			snd_rawmidi_close(input.rawmidi);
+			input.rawmidi = NULL;
+			return false;
+		}
+
+		input.fd = pollFd.fd;
+	}
+
+	g_rawMidiInputCount++;
+	printf("korgi: reading raw MIDI from '%s'\n", name.c_str());
+	return true;
+}
+
+void CloseRawMidi(RawMidiInput& input)
+{
+	if (input.rawmidi)
+		snd_rawmidi_close(input.rawmidi);
+	else if (input.fd >= 0)
+		close(input.fd);
+
+	input.rawmidi = NULL;
+	input.fd = -1;
+}
+#endif
+
+bool OpenMidiDevices()
+{
+#ifdef _WIN32
+	for (const DeviceConfig& device : g_config.devices)
+	{
+		if (!device.raw_midi.empty())
+			fprintf(stderr, "warning: raw_midi is not supported on Windows, opening device %d through WinMM\n", device.device);
+
+		HMIDIIN& handle = g_midiInHandles[g_midiDeviceCount];
+		if (midiInOpen(&handle, device.device, (DWORD_PTR)MidiInCallback, (DWORD_PTR)g_midiDeviceCount, CALLBACK_FUNCTION) != MMSYSERR_NOERROR)
+		{
+			fprintf(stderr, "error: failed to open midi device %d\n", device.device);
+			return false;
+		}
+
+		g_midiDeviceCount++;
+		midiInStart(handle);
+
+		MIDIINCAPS inCaps = {};
+		if (midiInGetDevCaps((UINT_PTR)device.device, &inCaps, sizeof(MIDIINCAPS)) == MMSYSERR_NOERROR)
+			printf("korgi: opened midi device %d called \"%s\"\n", device.device, inCaps.szPname);
+		else
+			printf("korgi: opened midi device %d but couldn't get its name...\n", device.device);
+	}
 
 	return true;
 #else
-	if (snd_seq_open(&g_midiInHandle, "default", SND_SEQ_OPEN_INPUT, 0))
+	// the sequencer is only needed for devices that aren't read directly
+	bool useSequencer = false;
+	for (const DeviceConfig& device : g_config.devices)
+		useSequencer = useSequencer || device.raw_midi.empty();
+
+	if (!useSequencer)
+	{
+		for (const DeviceConfig& device : g_config.devices)
+		{
+			if (!OpenRawMidi(device.raw_midi, g_midiDeviceCount++))
+				return false;
+		}
+
+		return true;
+	}
+
+	// output is needed to start the timestamping queue
+	if (snd_seq_open(&g_midiInHandle, "default", SND_SEQ_OPEN_DUPLEX, 0))
 	{
 		fprintf(stderr, "error: failed to connect to ALSA\n");
 		return false;
 	}
 
+	// Run() drains all buffered events after each wakeup and relies on
+	// snd_seq_event_input returning -EAGAIN when there are no more
+	snd_seq_nonblock(g_midiInHandle, 1);
+
 	g_midiPort = snd_seq_create_simple_port(g_midiInHandle,
 											"Korgi - MIDI to RCON",
 											SND_SEQ_PORT_CAP_WRITE,
 											SND_SEQ_PORT_TYPE_MIDI_GENERIC);
 
-	unsigned char korgDeviceId = GetMidiDeviceMatchingName(g_config.device_name.c_str());
-	if (!korgDeviceId)
+	// events are stamped with the real time of a queue that korgi runs itself
+	g_midiQueue = snd_seq_alloc_queue(g_midiInHandle);
+	if (g_midiQueue < 0 || snd_seq_start_queue(g_midiInHandle, g_midiQueue, NULL) < 0 || snd_seq_drain_output(g_midiInHandle) < 0)
 	{
-		fprintf(stderr, "error: failed to detect midi device '%s'\n", g_config.device_name.c_str());
-		return false;
+		fprintf(stderr, "warning: failed to start an ALSA queue, events will not be timestamped\n");
+		if (g_midiQueue >= 0)
+			snd_seq_free_queue(g_midiInHandle, g_midiQueue);
+		g_midiQueue = -1;
 	}
 
-	snd_seq_addr_t korgDevice, korgiListener;
-
-	korgDevice.client = korgDeviceId;
-	korgDevice.port = 0;
+	snd_seq_addr_t korgiListener;
 	korgiListener.client = snd_seq_client_id(g_midiInHandle);
-	korgiListener.port = 0;
+	korgiListener.port = g_midiPort;
 
-	if (snd_seq_port_subscribe_malloc(&g_midiSubscription))
+	for (const DeviceConfig& device : g_config.devices)
 	{
-		fprintf(stderr, "error: failed to allocate ALSA subscription, out of memory?\n");
-		return false;
-	}
+		if (!device.raw_midi.empty())
+		{
+			if (!OpenRawMidi(device.raw_midi, g_midiDeviceCount++))
+				return false;
+			continue;
+		}
 
-	snd_seq_port_subscribe_set_sender(g_midiSubscription, &korgDevice);
-	snd_seq_port_subscribe_set_dest(g_midiSubscription, &korgiListener);
-	snd_seq_port_subscribe_set_queue(g_midiSubscription, 1);
-	snd_seq_port_subscribe_set_time_update(g_midiSubscription, 1);
-	snd_seq_port_subscribe_set_time_real(g_midiSubscription, 1);
+		snd_seq_addr_t& korgDevice = g_midiSources[g_midiDeviceCount];
+		korgDevice.port = device.port;
 
-	if(snd_seq_subscribe_port(g_midiInHandle, g_midiSubscription))
-	{
-		fprintf(stderr, "error: failed to connect to midi device\n");
-		return false;
+		// a sequencer address such as "24:0" selects a client directly
+		int clientId, portId;
+		char extra;
+		if (sscanf(device.device_name.c_str(), "%d:%d%c", &clientId, &portId, &extra) == 2 && clientId > 0 && clientId < 256 && portId >= 0 && portId < 256)
+		{
+			korgDevice.client = (unsigned char)clientId;
+			korgDevice.port = (unsigned char)portId;
+		}
+		else
+		{
+			// the first device with a name gets the first client called that, the second one the next
+			int skip = 0;
+			for (int previous = 0; previous < g_midiDeviceCount; previous++)
+			{
+				const DeviceConfig& other = g_config.devices[previous];
+				if (other.raw_midi.empty() && other.device_name == device.device_name && other.port == device.port)
+					skip++;
+			}
+
+			korgDevice.client = GetMidiDeviceMatchingName(device.device_name.c_str(), skip);
+			if (!korgDevice.client)
+			{
+				fprintf(stderr, "error: failed to detect midi device '%s'\n", device.device_name.c_str());
+				return false;
+			}
+		}
+
+		snd_seq_port_subscribe_t*& subscription = g_midiSubscriptions[g_midiDeviceCount];
+		if (snd_seq_port_subscribe_malloc(&subscription))
+		{
+			fprintf(stderr, "error: failed to allocate ALSA subscription, out of memory?\n");
+			return false;
+		}
+
+		snd_seq_port_subscribe_set_sender(subscription, &korgDevice);
+		snd_seq_port_subscribe_set_dest(subscription, &korgiListener);
+
+		if (g_midiQueue >= 0)
+		{
+			snd_seq_port_subscribe_set_queue(subscription, g_midiQueue);
+			snd_seq_port_subscribe_set_time_update(subscription, 1);
+			snd_seq_port_subscribe_set_time_real(subscription, 1);
+		}
+
+		if (snd_seq_subscribe_port(g_midiInHandle, subscription))
+		{
+			fprintf(stderr, "error: failed to connect to midi device '%s'\n", device.device_name.c_str());
+			snd_seq_port_subscribe_free(subscription);
+			subscription = NULL;
+			return false;
+		}
+
+		g_midiDeviceCount++;
+
+		if (g_config.devices.size() > 1)
+			printf("korgi: listening to midi device '%s' port %d\n", device.device_name.c_str(), device.port);
 	}
 
 	g_pollFdCount = snd_seq_poll_descriptors_count(g_midiInHandle, POLLIN);
@@ -298,20 +479,283 @@ bool OpenMidiDevice()
 #endif
 }
 
-void CloseMidiDevice()
+void CloseMidiDevices()
 {
 #ifdef _WIN32
-	midiInClose(g_midiInHandle);
+	for (int device = 0; device < g_midiDeviceCount; device++)
+		midiInClose(g_midiInHandles[device]);
 #else
+	for (int input = 0; input < g_rawMidiInputCount; input++)
+		CloseRawMidi(g_rawMidiInputs[input]);
+	g_rawMidiInputCount = 0;
+
+	if (!g_midiInHandle)
+	{
+		g_midiDeviceCount = 0;
+		return;
+	}
+
 	free(g_pollFds);
-	snd_seq_port_subscribe_free(g_midiSubscription);
-	snd_seq_unsubscribe_port(g_midiInHandle, g_midiSubscription);
+	g_pollFds = NULL;
+	g_pollFdCount = 0;
+
+	for (int device = 0; device < g_midiDeviceCount; device++)
+	{
+		if (!g_midiSubscriptions[device])
+			continue;
+
+		snd_seq_unsubscribe_port(g_midiInHandle, g_midiSubscriptions[device]);
+		snd_seq_port_subscribe_free(g_midiSubscriptions[device]);
+		g_midiSubscriptions[device] = NULL;
+	}
+
 	snd_seq_delete_simple_port(g_midiInHandle, g_midiPort);
+	if (g_midiQueue >= 0)
+		snd_seq_free_queue(g_midiInHandle, g_midiQueue);
 	snd_seq_close(g_midiInHandle);
+	g_midiInHandle = NULL;
 #endif
-	g_midiInHandle = 0;
+	g_midiDeviceCount = 0;
+}
+
+#ifndef _WIN32
+// Passes an event from the sequencer, or from the reader thread, to the dispatcher
+void DispatchMidiInput(const MidiInputRecord& record)
+{
+	if (g_config.trace)
+	{
+		TraceDequeue(record.dequeued);
+
+		if (record.source_ns >= 0)
+			TraceSourceTime(record.source_ns, ToNanoseconds(record.dequeued.time_since_epoch()));
+	}
+
+	// stamped by the reader thread in pipelined mode
+	ReceiveMidiEvent(record.device, record.channel, record.value, record.dequeued);
+}
+
+// Dispatches an event right away, or queues it for the sender thread in pipelined mode
+void DeliverMidiInput(const MidiInputRecord& record, bool pipelined, bool& queued)
+{
+	if (!pipelined)
+	{
+		DispatchMidiInput(record);
+		return;
+	}
+
+	// the sender has fallen far behind, wait for it rather than lose the event
+	while (!PushMidiInput(record))
+	{
+		WakeSender();
+		this_thread::yield();
+	}
+
+	queued = true;
+}
+
+void ReadSequencerEvents(bool pipelined, bool& queued)
+{
+	for (;;)
+	{
+		snd_seq_event_t *event;
+		int err = snd_seq_event_input(g_midiInHandle, &event);
+
+		if (err == -ENOSPC)
+		{
+			fprintf(stderr, "\nwarning: ALSA input queue overrun, events were lost\n");
+			CountMetric(Metric::MidiOverruns);
+			continue;
+		}
+
+		if (err < 0)
+			break;
+
+		// the reader thread can't tell if tracing is on, so events are always stamped
+		MidiInputRecord record;
+		record.dequeued = Clock::now();
+		record.source_ns = -1;
+		if ((event->flags & SND_SEQ_TIME_STAMP_MASK) == SND_SEQ_TIME_STAMP_REAL)
+			record.source_ns = int64_t(event->time.time.tv_sec) * 1000000000 + event->time.time.tv_nsec;
+
+		int device = GetMidiSourceDevice(event->source);
+		record.device = (unsigned char)device;
+
+		// the event data is a union whose layout depends on the type
+		switch (event->type)
+		{
+		case SND_SEQ_EVENT_CONTROLLER:
+			record.channel = (unsigned char)event->data.control.param;
+			record.value = (unsigned char)event->data.control.value;
+			break;
+		case SND_SEQ_EVENT_NOTEON:
+			record.channel = event->data.note.note;
+			record.value = event->data.note.velocity;
+			break;
+		case SND_SEQ_EVENT_NOTEOFF:
+			record.channel = event->data.note.note;
+			record.value = 0;
+			break;
+		default:
+			// pitch bends and anything else without a control number
+			device = -1;
+			break;
+		}
+
+		snd_seq_free_event(event);
+
+		if (device >= 0)
+			DeliverMidiInput(record, pipelined, queued);
+	}
+}
+
+// Reads what is available from a raw MIDI input and decodes it. An input that has ended,
+// such as an unplugged device or a pipe without writers, is closed.
+void ReadRawMidi(RawMidiInput& input, bool pipelined, bool& queued)
+{
+	while (input.fd >= 0)
+	{
+		unsigned char buffer[256];
+		ssize_t length;
+		if (input.rawmidi)
+		{
+			length = snd_rawmidi_read(input.rawmidi, buffer, sizeof(buffer));
+			if (length == -EAGAIN || length == -EINTR)
+				break;
+		}
+		else
+		{
+			length = read(input.fd, buffer, sizeof(buffer));
+			if (length < 0 && (errno == EAGAIN || errno == EINTR))
+				break;
+		}
+
+		if (length <= 0)
+		{
+			fprintf(stderr, "\nwarning: raw MIDI input '%s' has ended\n", input.name.c_str());
+			CloseRawMidi(input);
+			break;
+		}
+
+		MidiInputRecord record;
+		record.dequeued = Clock::now();
+		record.source_ns = -1; // raw MIDI has no timestamps
+		record.device = (unsigned char)input.device;
+
+		MidiMessage message;
+		for (ssize_t i = 0; i < length; i++)
+		{
+			if (input.parser.Parse(buffer[i], message) && GetMidiControl(message, record.channel, record.value))
+				DeliverMidiInput(record, pipelined, queued);
+		}
+	}
+}
+
+// The inputs are non-blocking, so this reads everything they have buffered rather than one
+// event per ready descriptor. In pipelined mode, the events are queued for the sender thread,
+// which is then woken up once.
+void ReadMidiEvents(bool pipelined)
+{
+	bool queued = false;
+
+	if (g_midiInHandle)
+		ReadSequencerEvents(pipelined, queued);
+
+	for (int input = 0; input < g_rawMidiInputCount; input++)
+		ReadRawMidi(g_rawMidiInputs[input], pipelined, queued);
+
+	if (queued)
+		WakeSender();
+}
+
+void MidiReaderThread(ThreadConfig scheduling)
+{
+	SetThreadScheduling(scheduling, "reader");
+
+	vector<pollfd> pollFds(g_pollFds, g_pollFds + g_pollFdCount);
+	for (int input = 0; input < g_rawMidiInputCount; input++)
+		pollFds.push_back({ g_rawMidiInputs[input].fd, POLLIN, 0 });
+	pollFds.push_back({ g_readerStopFd, POLLIN, 0 });
+
+	for (;;)
+	{
+		if (poll(pollFds.data(), pollFds.size(), -1) < 0)
+			continue;
+
+		if (pollFds.back().revents)
+			break;
+
+		ReadMidiEvents(true);
+
+		// poll skips the inputs that have ended and been closed
+		for (int input = 0; input < g_rawMidiInputCount; input++)
+			pollFds[g_pollFdCount + input].fd = g_rawMidiInputs[input].fd;
+	}
+}
+
+bool StartMidiReader()
+{
+	g_readerStopFd = eventfd(0, EFD_CLOEXEC);
+	if (g_readerStopFd < 0)
+	{
+		fprintf(stderr, "error: failed to create an eventfd for the reader thread\n");
+		return false;
+	}
+
+	if (!OpenPipeline())
+		return false;
+
+	// signals are handled by the main loop, the reader thread inherits a mask that blocks them
+	sigset_t signals, previousSignals;
+	sigfillset(&signals);
+	pthread_sigmask(SIG_BLOCK, &signals, &previousSignals);
+
+	bool started = true;
+	try
+	{
+		g_midiReader = std::thread(MidiReaderThread, g_config.reader_thread);
+	}
+	catch (const std::system_error&)
+	{
+		started = false;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &previousSignals, NULL);
+
+	if (!started)
+	{
+		fprintf(stderr, "error: failed to start the MIDI reader thread\n");
+		return false;
+	}
+
+	g_pipelineMode = g_config.pipeline;
+	return true;
 }
 
+// Stops the reader thread and dispatches the events that it has left in the queue
+void StopMidiReader()
+{
+	if (g_midiReader.joinable())
+	{
+		uint64_t one = 1;
+		if (write(g_readerStopFd, &one, sizeof(one)) == sizeof(one))
+			g_midiReader.join();
+		else
+			g_midiReader.detach();
+
+		MidiInputRecord record;
+		while (PopMidiInput(record))
+			DispatchMidiInput(record);
+	}
+
+	if (g_readerStopFd >= 0)
+		close(g_readerStopFd);
+	g_readerStopFd = -1;
+
+	ClosePipeline();
+	g_pipelineMode = PipelineMode::Off;
+}
+#endif
+
 #if _WIN32
 void PrintMidiDevices()
 {
@@ -327,8 +771,6 @@ void PrintMidiDevices()
 }
 #endif
 
-std::string g_configFileName;
-
 #if _WIN32
 FILETIME g_lastConfigWriteTimestamp = { 0 };
 
@@ -365,294 +807,301 @@ bool ConfigFileChanged()
 	return true;
 }
 
-#else
-
-bool ConfigFileChanged()
+bool WatchConfigFile()
 {
-	return false;
+	// primes the last write timestamp, so that only later changes trigger a reload
+	ConfigFileChanged();
+	return true;
 }
 
-#endif
+#else
 
-// a version of strtok that supports double quotes
-char* tokenize(char* str, const char* delimiters)
-{
-	static char* next = NULL;
-	if (str) next = str;
+int g_configWatchFd = -1;
+int g_configFileWatch = -1;
+std::string g_configFileBaseName;
 
-	while (*next)
+bool WatchConfigFile()
+{
+	g_configWatchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (g_configWatchFd < 0)
 	{
-		if (!strchr(delimiters, *next))
-			break;
-
-		next++;
+		fprintf(stderr, "warning: failed to initialize inotify, config file changes will not be detected\n");
+		return false;
 	}
 
-	if (!*next)
-		return NULL;
+	size_t slash = g_configFileName.rfind('/');
+	std::string directory = slash == std::string::npos ? "." : g_configFileName.substr(0, slash + 1);
+	g_configFileBaseName = slash == std::string::npos ? g_configFileName : g_configFileName.substr(slash + 1);
 
-	if (*next == '"')
-	{
-		next++;
-		delimiters = "\"";
-	}
+	// editors that save by writing a new file and renaming it over the old one
+	// are only seen through the directory
+	if (inotify_add_watch(g_configWatchFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		fprintf(stderr, "warning: failed to watch directory %s\n", directory.c_str());
+
+	g_configFileWatch = inotify_add_watch(g_configWatchFd, g_configFileName.c_str(), IN_CLOSE_WRITE);
 
-	char* start = next;
+	return true;
+}
+
+// Consumes the pending inotify events, only call when g_configWatchFd is readable
+bool ConfigFileChanged()
+{
+	bool changed = false;
 
-	while (*next)
+	alignas(inotify_event) char buffer[4096];
+	ssize_t length;
+	while ((length = read(g_configWatchFd, buffer, sizeof(buffer))) > 0)
 	{
-		if(strchr(delimiters, *next))
+		for (char* ptr = buffer; ptr < buffer + length; )
 		{
-			*next = 0;
-			next++;
-			break;
-		}
+			const inotify_event* event = (const inotify_event*)ptr;
+
+			if (event->wd == g_configFileWatch || (event->len && g_configFileBaseName == event->name))
+				changed = true;
 
-		next++;
+			ptr += sizeof(inotify_event) + event->len;
+		}
 	}
 
-	return start;
+	// the file may have been replaced, keep watching the new one
+	if (changed)
+		g_configFileWatch = inotify_add_watch(g_configWatchFd, g_configFileName.c_str(), IN_CLOSE_WRITE);
+
+	return changed;
 }
 
-bool ReadConfigFile()
+#endif
+
+#ifdef _WIN32
+void SignalHandler(int signal)
 {
-	struct KorgiConfig new_config = g_config;
+	g_terminate = 1;
+}
 
-	FILE* file = fopen(g_configFileName.c_str(), "r");
-	if (!file)
-	{
-		fprintf(stderr, "error: couldn't open %s\n", g_configFileName.c_str());
+// Milliseconds to sleep until 'deadline', capped at 'limit'
+int GetTimeoutMs(Clock::time_point deadline, int limit)
+{
+	if (deadline == Clock::time_point::max())
+		return limit;
+
+	auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - Clock::now() + chrono::microseconds(999));
+	return int(max<long long>(0, min<long long>(limit, remaining.count())));
+}
+#else
+// Descriptors in the event loop besides its timer and signals
+enum
+{
+	MidiInputTag,   // the sequencer, or the wakeup of the reader thread in pipelined mode
+	ConfigWatchTag,
+	SocketTag,      // replies from the targets
+	MetricsListenTag,
+	MetricsClientTag, // plus the descriptor of the client, so this must come last
+};
+
+EventLoop g_eventLoop;
+MetricsServer g_metricsServer;
+
+// Signals that arrive through the event loop, blocked in all threads
+sigset_t g_loopSignals;
+
+void BlockLoopSignals()
+{
+	sigemptyset(&g_loopSignals);
+	sigaddset(&g_loopSignals, SIGINT);
+	sigaddset(&g_loopSignals, SIGTERM);
+	sigaddset(&g_loopSignals, SIGHUP);
+	sigaddset(&g_loopSignals, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &g_loopSignals, NULL);
+}
+
+bool OpenEventLoop()
+{
+	if (!g_eventLoop.Open(g_loopSignals))
 		return false;
-	}
 
 	bool success = true;
-	char linebuf[256];
-	int lineno = 0;
-	while (fgets(linebuf, sizeof(linebuf), file))
+	if (g_pipelineMode != PipelineMode::Off)
 	{
-		lineno++;
+		success = g_eventLoop.Add(GetSenderWakeFd(), MidiInputTag);
+	}
+	else
+	{
+		for (int i = 0; i < g_pollFdCount; i++)
+			success = success && g_eventLoop.Add(g_pollFds[i].fd, MidiInputTag);
+		for (int input = 0; input < g_rawMidiInputCount; input++)
+			success = success && g_eventLoop.Add(g_rawMidiInputs[input].fd, MidiInputTag);
+	}
 
-		{ char* t = strchr(linebuf, '#'); if (t) *t = 0; } // remove comments
-		{ char* t = strchr(linebuf, '\n'); if (t) *t = 0; } // remove newline
+	if (g_configWatchFd >= 0)
+		success = success && g_eventLoop.Add(g_configWatchFd, ConfigWatchTag);
 
-		const char* delimiters = " \t\r\n";
-		char* command = tokenize(linebuf, delimiters);
+	if (g_metricsServer.GetListenDescriptor() >= 0)
+		success = success && g_eventLoop.Add(g_metricsServer.GetListenDescriptor(), MetricsListenTag);
 
-		if (!command)
-			continue;
+	return success && g_eventLoop.Add(GetSocketDescriptor(), SocketTag);
+}
 
-		if (strcmp(command, "connect") == 0)
-		{
-			char* addr = tokenize(nullptr, delimiters);
-			char* port = tokenize(nullptr, delimiters);
+// Accepts the pending metrics clients, which are answered once their request arrives
+void AcceptMetricsClients()
+{
+	int client;
+	while ((client = g_metricsServer.Accept()) >= 0)
+	{
+		if (!g_eventLoop.Add(client, MetricsClientTag + client))
+			close(client);
+	}
+}
 
-			if (!addr)
-			{
-				fprintf(stderr, "%s:%d: insufficient parameters for 'connect'\n", g_configFileName.c_str(), lineno);
-				success = false;
-				continue;
-			}
+// Handles the pending signals, returns true if the config should be reloaded
+bool HandleSignals()
+{
+	bool reload = false;
 
-			new_config.address = addr;
-			if (port) new_config.port = atoi(port);
-		}
-		else if (strcmp(command, "password") == 0)
+	while (int signal = g_eventLoop.ReadSignal())
+	{
+		switch (signal)
 		{
-			char* password = tokenize(nullptr, delimiters);
-
-			if (!password)
-			{
-				fprintf(stderr, "%s:%d: insufficient parameters for 'password'\n", g_configFileName.c_str(), lineno);
-				success = false;
-				continue;
-			}
-
-			new_config.password = password;
+		case SIGINT:
+		case SIGTERM:
+			g_terminate = 1;
+			break;
+		case SIGHUP:
+			reload = true;
+			break;
+		case SIGUSR1:
+			PrintTraceReport();
+			break;
 		}
-		else if (strcmp(command, "device") == 0)
-		{
-			char* device = tokenize(nullptr, delimiters);
+	}
 
-			if (!device)
-			{
-				fprintf(stderr, "%s:%d: insufficient parameters for 'device'\n", g_configFileName.c_str(), lineno);
-				success = false;
-				continue;
-			}
+	return reload;
+}
+#endif
 
-			new_config.device = atoi(device);
-		}
-		else if (strcmp(command, "device_name") == 0)
-		{
-			char* device_name = tokenize(nullptr, delimiters);
+void Run()
+{
+	Clock::time_point nextFlush = Clock::time_point::max();
+	Clock::time_point nextReplay = g_replaying ? Clock::now() : Clock::time_point::max();
 
-			if (!device_name)
-			{
-				fprintf(stderr, "%s:%d: insufficient parameters for 'device_name'\n", g_configFileName.c_str(), lineno);
-				success = false;
-				continue;
-			}
+#ifndef _WIN32
+	// a busy sender only looks at the other descriptors every now and then
+	Clock::time_point nextEventPoll = Clock::now();
+#endif
 
-			new_config.device_name = device_name;
-		}
-		else if (strcmp(command, "device_map") == 0)
-		{
-			char* device_map = tokenize(nullptr, delimiters);
+	while (!g_terminate)
+	{
+#ifdef _WIN32
+		//Quiet spin
+		Sleep(GetTimeoutMs(min(nextFlush, nextReplay), 50));
 
-			if (!device_map)
-			{
-				fprintf(stderr, "%s:%d: insufficient parameters for 'device_map'\n", g_configFileName.c_str(), lineno);
-				success = false;
-				continue;
-			}
+		std::lock_guard<std::mutex> lock(g_dispatchMutex);
+#else
+		bool midiReady = false;
+		bool configChanged = false;
+		bool pollEvents = true;
+		bool sleeping = false;
+		int timeout = -1;
 
-			if (!setControlSurfaceType(device_map))
-			{
-				fprintf(stderr, "%s:%d: unsupported control surface type '%s'\n", g_configFileName.c_str(), lineno, device_map);
-				success = false;
-				continue;
-			}
-		}
-		else if (strcmp(command, "button") == 0)
+		if (g_pipelineMode == PipelineMode::Busy)
 		{
-			char* channel = tokenize(nullptr, delimiters);
-			char* command = channel + strlen(channel) + 1;
+			// the queue is checked on every iteration instead of waiting for the reader to signal it
+			midiReady = true;
 
-			if (!channel || !*command)
+			Clock::time_point now = Clock::now();
+			pollEvents = now >= nextEventPoll;
+			if (pollEvents)
 			{
-				fprintf(stderr, "%s:%d: insufficient parameters for 'button'\n", g_configFileName.c_str(), lineno);
-				success = false;
-				continue;
-			}
-
-			char *endptr = nullptr;
-			int c = strtol(channel, &endptr, 10);
-			if (endptr - channel != strlen(channel))
-			{
-				// invalid integer, try control surface alias
-				ControlSurface surf;
-				if (!mapControl(surf, channel))
-				{
-					fprintf(stderr, "%s:%d: invalid channel number or button alias '%s'\n", g_configFileName.c_str(), lineno, channel);
-					success = false;
-					continue;
-				}
-
-				if (surf.type != ControlSurface::Type::Button)
-				{
-					fprintf(stderr, "%s:%d: control surface '%s' is not a button\n", g_configFileName.c_str(), lineno, channel);
-					success = false;
-					continue;
-				}
-
-				new_config.buttons[surf.channel] = command;
-			} else {
-				new_config.buttons[c] = command;
+				nextEventPoll = now + BUSY_EVENT_POLL_INTERVAL;
+				timeout = 0;
 			}
 		}
-		else if (strcmp(command, "knob") == 0 || strcmp(command, "slider") == 0)
+		else
 		{
-			bool isKnob = strcmp(command, "knob") == 0;
-
-			char* channel = tokenize(nullptr, delimiters);
-			char* cvar = tokenize(nullptr, delimiters);
-			char* vmin = tokenize(nullptr, delimiters);
-			char* vmax = tokenize(nullptr, delimiters);
+			// timed work wakes the loop up through the timer
+			g_eventLoop.SetDeadline(min(nextFlush, nextReplay));
 
-			if (!channel || !cvar || !vmin || !vmax)
+			sleeping = g_pipelineMode == PipelineMode::On && BeginSenderSleep();
+			if (g_pipelineMode == PipelineMode::On && !sleeping)
 			{
-				fprintf(stderr, "%s:%d: insufficient parameters for '%s'\n", g_configFileName.c_str(), lineno, command);
-				success = false;
-				continue;
+				// records arrived while BeginSenderSleep() was checking
+				midiReady = true;
+				timeout = 0;
 			}
+		}
 
-			KnobMapping mapping;
-			mapping.name = cvar;
-			mapping.min_value = float(atof(vmin));
-			mapping.max_value = float(atof(vmax));
+		if (pollEvents)
+		{
+			int tags[16];
+			int count = g_eventLoop.Wait(tags, 16, timeout);
 
-			char *endptr = nullptr;
-			int c = strtol(channel, &endptr, 10);
-			if (endptr - channel != strlen(channel))
+			bool woken = false;
+			for (int i = 0; i < count; i++)
 			{
-				// invalid integer, try control surface alias
-				ControlSurface surf;
-				if (!mapControl(surf, channel))
+				switch (tags[i])
 				{
-					fprintf(stderr, "%s:%d: invalid channel number or %s alias '%s'\n", g_configFileName.c_str(), lineno, command, channel);
-					success = false;
-					continue;
+				case MidiInputTag:
+					midiReady = true;
+					woken = true;
+					break;
+				case ConfigWatchTag:
+					configChanged = ConfigFileChanged() || configChanged;
+					break;
+				case SocketTag:
+					ReceiveReplies();
+					break;
+				case EventLoop::SignalTag:
+					configChanged = HandleSignals() || configChanged;
+					break;
+				case MetricsListenTag:
+					AcceptMetricsClients();
+					break;
+				default:
+					if (tags[i] >= MetricsClientTag)
+						g_metricsServer.Serve(tags[i] - MetricsClientTag);
+					break;
 				}
+			}
 
-				if ((isKnob && surf.type != ControlSurface::Type::RotaryKnob) ||
-					(!isKnob && surf.type != ControlSurface::Type::Slider))
-				{
-					fprintf(stderr, "%s:%d: control surface '%s' is not a %s\n", g_configFileName.c_str(), lineno, channel, command);
-					success = false;
-					continue;
-				}
+			if (sleeping)
+				EndSenderSleep(woken);
+		}
+#endif
 
-				new_config.knobs[surf.channel] = mapping;
-			} else {
-				new_config.knobs[c] = mapping;
-			}
+		// everything sent during one wakeup goes out in as few packets as possible
+		BeginBatch();
+
+#ifndef _WIN32
+		if (midiReady && g_pipelineMode != PipelineMode::Off)
+		{
+			MidiInputRecord record;
+			while (PopMidiInput(record))
+				DispatchMidiInput(record);
 		}
-		else
+		else if (midiReady)
 		{
-			fprintf(stderr, "%s:%d: unknown directive '%s'\n", g_configFileName.c_str(), lineno, command);
-			success = false;
-			continue;
+			ReadMidiEvents(false);
 		}
-	}
-
-	fclose(file);
-
-	if (new_config.password.size() == 0)
-	{
-		fprintf(stderr, "%s: password not specified\n", g_configFileName.c_str());
-		success = false;
-	}
+#endif
 
-	if (success)
-	{
-		printf("korgi: mapping %d knobs and %d buttons\n", int(new_config.knobs.size()), int(new_config.buttons.size()));
-		g_config = new_config;
-	}
+		if (g_replaying)
+			nextReplay = ReplayMidiEvents(Clock::now());
 
-	return success;
-}
+		nextFlush = FlushPendingKnobs(Clock::now(), false);
 
-void SignalHandler(int signal)
-{
-	g_terminate = true;
-}
+		EndBatch();
 
-void Run()
-{
-	while (!g_terminate)
-	{
 #ifdef _WIN32
-		//Quiet spin
-		Sleep(50);
-#else
-		for (int i = poll(g_pollFds, g_pollFdCount, 60*1000); i > 0; i--)
-		{
-			snd_seq_event_t *event;
-			snd_seq_event_input(g_midiInHandle, &event);
-
-			unsigned char event_chn = event->data.control.param;
-			unsigned char event_val = event->data.control.value;
-
-			HandleMidiInput(event_chn, event_val);
-
-			snd_seq_free_event(event);
-		}
+		bool configChanged = ConfigFileChanged();
 #endif
 
-		if (ConfigFileChanged())
+		if (configChanged && !g_terminate)
 		{
 			fprintf(stderr, "reloading config file\n");
-			ReadConfigFile();
+			CountMetric(Metric::ConfigReloads);
+			bool applied = ReadConfigFile();
+			if (!applied)
+				CountMetric(Metric::ConfigReloadFailures);
+			RecordFlightReload(applied);
 		}
 	}
 }
@@ -664,8 +1113,12 @@ int main(int argc, char** argv)
 	if (argc > 1)
 		g_configFileName = argv[1];
 
-	// initialize the config file timestamp
-	ConfigFileChanged();
+#ifndef _WIN32
+	// signals are read by the event loop, so they must be blocked before any thread is started
+	BlockLoopSignals();
+#endif
+
+	WatchConfigFile();
 
 	if (!ReadConfigFile())
 		return 1;
@@ -673,17 +1126,110 @@ int main(int argc, char** argv)
 	if (!OpenSocket())
 		return 1;
 
-	if (!OpenMidiDevice())
+#ifndef _WIN32
+	if (g_config.io_uring)
+	{
+		if (OpenUringTransport(g_config.io_uring_buffers))
+			printf("korgi: sending through io_uring\n");
+		else
+			fprintf(stderr, "warning: sending with sendmmsg instead of io_uring\n");
+	}
+
+	if (!g_config.metrics_address.empty())
+	{
+		if (!g_metricsServer.Open(g_config.metrics_address, g_config.metrics_port))
+			return 1;
+
+		if (g_config.metrics_port)
+			printf("korgi: serving metrics on %s:%d\n", g_config.metrics_address.c_str(), g_config.metrics_port);
+		else
+			printf("korgi: serving metrics on %s\n", g_config.metrics_address.c_str());
+	}
+#else
+	if (!g_config.metrics_address.empty())
+		fprintf(stderr, "warning: the metrics endpoint is not supported on Windows\n");
+#endif
+
+	if (!g_config.replay_file.empty())
+	{
+		if (!OpenReplay())
+			return 1;
+	}
+	else if (!OpenMidiDevices())
 		return 1;
 
+#ifdef _WIN32
+	if (g_config.pipeline != PipelineMode::Off)
+		fprintf(stderr, "warning: the pipelined mode is not supported on Windows, WinMM reads MIDI on its own thread\n");
+#else
+	if (g_config.pipeline != PipelineMode::Off && g_config.replay_file.empty())
+	{
+		if (!StartMidiReader())
+			return 1;
+
+		printf("korgi: reading MIDI events on a separate thread\n");
+	}
+#endif
+
+	if (!g_config.flight_recorder_file.empty())
+	{
+		if (!OpenFlightRecorder(g_config.flight_recorder_file, g_config.flight_recorder_records))
+			return 1;
+
+		printf("korgi: flight recorder in %s\n", g_config.flight_recorder_file.c_str());
+	}
+
+	if (!g_config.record_file.empty())
+	{
+		if (!g_midiRecorder.Open(g_config.record_file))
+			return 1;
+
+		printf("korgi: recording MIDI events to %s\n", g_config.record_file.c_str());
+	}
+
+#ifndef _WIN32
+	if (!OpenEventLoop())
+		return 1;
+#endif
+
+	if (!StartLogger())
+		return 1;
+
+#ifdef _WIN32
 	signal(SIGINT, SignalHandler);
+#endif
+
+	SetThreadScheduling(g_config.sender_thread, "sender");
 	
 	Run();
 
+#ifndef _WIN32
+	StopMidiReader();
+#endif
+
+	FlushPendingKnobs(Clock::now(), true);
+	StopLogger();
+
+	if (g_config.trace)
+		PrintTraceReport();
+
+	if (GetSuppressedUpdateCount())
+		printf("\nkorgi: suppressed %llu redundant knob updates", (unsigned long long)GetSuppressedUpdateCount());
+
+	if (GetResyncSnapshotCount())
+		printf("\nkorgi: sent %llu resync snapshots", (unsigned long long)GetResyncSnapshotCount());
+
 	printf("\n");
 	printf("korgi: shutting down...\n");
 
-	CloseMidiDevice();
+	CloseMidiDevices();
+	g_midiRecorder.Close();
+	g_midiReplay.Close();
+	CloseFlightRecorder();
+#ifndef _WIN32
+	g_eventLoop.Close();
+	g_metricsServer.Close();
+#endif
 	CloseSocket();
 
 	return 0;
@@ -0,0 +1,227 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+// Threads beyond this share one set of counters that is updated atomically
+#define MAX_METRIC_THREADS 16
+
+struct alignas(64) ThreadMetrics
+{
+	std::atomic<uint64_t> values[int(Metric::Count)] = {};
+};
+
+static ThreadMetrics g_threadMetrics[MAX_METRIC_THREADS];
+static ThreadMetrics g_sharedMetrics;
+static std::atomic<int> g_threadMetricCount(0);
+static thread_local ThreadMetrics* t_metrics = nullptr;
+
+struct MetricInfo
+{
+	const char* name;
+	const char* help;
+};
+
+static const MetricInfo g_metricInfo[int(Metric::Count)] = {
+	{ "korgi_midi_events_total", "MIDI events passed to the dispatcher." },
+	{ "korgi_midi_overruns_total", "Overflows of the ALSA input queue, which lose events." },
+	{ "korgi_unmapped_events_total", "MIDI events on channels without a mapping." },
+	{ "korgi_suppressed_updates_total", "Knob updates dropped because they would not change the output." },
+	{ "korgi_packets_sent_total", "UDP datagrams sent, one per target." },
+	{ "korgi_bytes_sent_total", "Bytes of the UDP datagrams sent." },
+	{ "korgi_send_errors_total", "UDP datagrams that failed to send." },
+	{ "korgi_resync_snapshots_total", "Snapshots of all knob values sent." },
+	{ "korgi_replies_total", "Console replies received from the targets." },
+	{ "korgi_config_reloads_total", "Config file reloads, including failed ones." },
+	{ "korgi_config_reload_failures_total", "Config file reloads that failed and kept the previous config." },
+};
+
+void CountMetric(Metric metric, uint64_t count)
+{
+	if (!t_metrics)
+	{
+		int index = g_threadMetricCount.fetch_add(1, std::memory_order_relaxed);
+		t_metrics = index < MAX_METRIC_THREADS ? &g_threadMetrics[index] : &g_sharedMetrics;
+	}
+
+	std::atomic<uint64_t>& value = t_metrics->values[int(metric)];
+
+	// only the owning thread writes its counters, so there is no need for a locked add
+	if (t_metrics != &g_sharedMetrics)
+		value.store(value.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+	else
+		value.fetch_add(count, std::memory_order_relaxed);
+}
+
+uint64_t GetMetric(Metric metric)
+{
+	uint64_t sum = g_sharedMetrics.values[int(metric)].load(std::memory_order_relaxed);
+	for (const ThreadMetrics& thread : g_threadMetrics)
+		sum += thread.values[int(metric)].load(std::memory_order_relaxed);
+
+	return sum;
+}
+
+std::string FormatMetrics()
+{
+	std::string text;
+	char line[256];
+
+	for (int metric = 0; metric < int(Metric::Count); metric++)
+	{
+		const MetricInfo& info = g_metricInfo[metric];
+		snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", info.name, info.help, info.name, info.name,
+			(unsigned long long)GetMetric(Metric(metric)));
+		text += line;
+	}
+
+	return text;
+}
+
+#ifndef _WIN32
+
+bool MetricsServer::Open(const std::string& address, int port)
+{
+	Close();
+
+	if (port)
+	{
+		sockaddr_in local = {};
+		local.sin_family = AF_INET;
+		local.sin_port = htons(port);
+		if (inet_pton(AF_INET, address.c_str(), &local.sin_addr) != 1)
+		{
+			fprintf(stderr, "error: invalid metrics address '%s'\n", address.c_str());
+			return false;
+		}
+
+		m_listen = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+		int reuse = 1;
+		if (m_listen >= 0)
+			setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		if (m_listen < 0 || bind(m_listen, (sockaddr*)&local, sizeof(local)) < 0 || listen(m_listen, 8) < 0)
+		{
+			fprintf(stderr, "error: failed to listen for metrics on %s:%d: %s\n", address.c_str(), port, strerror(errno));
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	sockaddr_un local = {};
+	local.sun_family = AF_UNIX;
+	if (address.size() >= sizeof(local.sun_path))
+	{
+		fprintf(stderr, "error: the metrics socket path '%s' is too long\n", address.c_str());
+		return false;
+	}
+
+	memcpy(local.sun_path, address.c_str(), address.size() + 1);
+
+	// a socket left behind by a previous run would make bind fail, anything else at the path is kept
+	struct stat status = {};
+	if (lstat(address.c_str(), &status) == 0)
+	{
+		if (!S_ISSOCK(status.st_mode))
+		{
+			fprintf(stderr, "error: the metrics socket path '%s' exists and isn't a socket\n", address.c_str());
+			return false;
+		}
+
+		unlink(address.c_str());
+	}
+
+	m_listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (m_listen < 0 || bind(m_listen, (sockaddr*)&local, sizeof(local)) < 0 || listen(m_listen, 8) < 0)
+	{
+		fprintf(stderr, "error: failed to listen for metrics on %s: %s\n", address.c_str(), strerror(errno));
+		Close();
+		return false;
+	}
+
+	m_unixPath = address;
+	return true;
+}
+
+void MetricsServer::Close()
+{
+	if (m_listen >= 0)
+		close(m_listen);
+	m_listen = -1;
+
+	if (!m_unixPath.empty())
+		unlink(m_unixPath.c_str());
+	m_unixPath.clear();
+}
+
+int MetricsServer::Accept()
+{
+	return accept4(m_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+
+void MetricsServer::Serve(int client)
+{
+	// whatever the request is, the answer is the same, so it only has to be read
+	// to keep the close from resetting the connection
+	char request[1024];
+	ssize_t length;
+	ssize_t total = 0;
+	while ((length = read(client, request, sizeof(request))) > 0)
+		total += length;
+
+	if (total > 0)
+	{
+		std::string body = FormatMetrics();
+		char header[128];
+		int headerLength = snprintf(header, sizeof(header),
+			"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", body.size());
+
+		// a few hundred bytes fit into any socket buffer, so the writes don't block
+		std::string response = std::string(header, headerLength) + body;
+		// a scraper that has already gone away must not raise SIGPIPE, which would end korgi
+		if (send(client, response.data(), response.size(), MSG_NOSIGNAL) < 0 && errno != EPIPE && errno != ECONNRESET)
+			fprintf(stderr, "\nwarning: failed to send metrics: %s\n", strerror(errno));
+	}
+
+	close(client);
+}
+
+#endif
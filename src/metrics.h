@@ -0,0 +1,79 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// Runtime counters. Every thread increments its own copy with plain stores, and the copies are
+// only summed when the counters are read, so counting never contends between threads.
+enum class Metric
+{
+	MidiEvents,        // events passed to the dispatcher, from any input
+	MidiOverruns,      // times the ALSA input queue overflowed and events were lost
+	UnmappedEvents,    // events on channels without a mapping
+	SuppressedUpdates, // knob updates dropped by the filter
+	PacketsSent,       // UDP datagrams handed to the kernel, one per target
+	BytesSent,
+	SendErrors,        // datagrams that the kernel failed to send
+	ResyncSnapshots,
+	Replies,           // rcon replies received from the targets
+	ConfigReloads,
+	ConfigReloadFailures,
+	Count,
+};
+
+void CountMetric(Metric metric, uint64_t count = 1);
+
+// Sum over all threads
+uint64_t GetMetric(Metric metric);
+
+// All counters in the Prometheus text exposition format
+std::string FormatMetrics();
+
+#ifndef _WIN32
+// Serves FormatMetrics() over HTTP to anything that connects, on a TCP port or a Unix socket.
+// The descriptors are non-blocking and meant to be watched by the event loop of the caller.
+class MetricsServer
+{
+public:
+	~MetricsServer() { Close(); }
+
+	// 'address' is an IPv4 address, or the path of a Unix socket if 'port' is 0
+	bool Open(const std::string& address, int port);
+	void Close();
+
+	int GetListenDescriptor() const { return m_listen; }
+
+	// Returns a connected client to watch for readability, or -1
+	int Accept();
+
+	// Reads the request of a client and answers it. The client is closed afterwards, which
+	// removes it from any epoll set.
+	void Serve(int client);
+
+private:
+	int m_listen = -1;
+	std::string m_unixPath;
+};
+#endif
@@ -0,0 +1,127 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Streaming decoder of a raw MIDI byte stream, as read from a raw MIDI device or a pipe.
+// Handles running status, where a message repeats the status of the previous one by leaving
+// it out, and skips system exclusive messages, system common messages and the real-time
+// bytes that may appear anywhere, even in the middle of another message.
+
+// Channel voice messages, by the high nibble of their status byte
+enum class MidiMessageType : uint8_t
+{
+	NoteOff = 0x8,
+	NoteOn = 0x9,
+	PolyPressure = 0xa,
+	ControlChange = 0xb,
+	ProgramChange = 0xc,
+	ChannelPressure = 0xd,
+	PitchBend = 0xe,
+};
+
+struct MidiMessage
+{
+	MidiMessageType type;
+	uint8_t channel; // MIDI channel 0-15, not a control
+	uint8_t data1;   // note, controller or program number, or the low 7 bits of a pitch bend
+	uint8_t data2;   // velocity, controller value or pressure, or the high 7 bits of a pitch bend
+
+	// -8192 to 8191, 0 is the center
+	int GetPitchBend() const { return (data2 << 7 | data1) - 8192; }
+};
+
+class MidiParser
+{
+public:
+	// Feeds the next byte of the stream, returns true if it completes 'message'
+	bool Parse(uint8_t byte, MidiMessage& message)
+	{
+		if (byte >= 0xf8)
+			return false; // real-time bytes don't interrupt anything
+
+		if (byte & 0x80)
+		{
+			// a status byte ends any unfinished message. System messages cancel the running status,
+			// and the data bytes of system common messages are skipped like those of system exclusive.
+			m_status = byte < 0xf0 ? byte : 0;
+			m_expected = (byte & 0xf0) == 0xc0 || (byte & 0xf0) == 0xd0 ? 1 : 2;
+			m_count = 0;
+			return false;
+		}
+
+		if (!m_status)
+			return false;
+
+		m_data[m_count++] = byte;
+		if (m_count < m_expected)
+			return false;
+
+		// the status stays for the next message
+		m_count = 0;
+
+		message.type = MidiMessageType(m_status >> 4);
+		message.channel = m_status & 0x0f;
+		message.data1 = m_data[0];
+		message.data2 = m_expected == 2 ? m_data[1] : 0;
+
+		// a note on with velocity 0 is the usual way to send a note off with running status
+		if (message.type == MidiMessageType::NoteOn && message.data2 == 0)
+			message.type = MidiMessageType::NoteOff;
+
+		return true;
+	}
+
+	void Reset()
+	{
+		m_status = 0;
+		m_count = 0;
+	}
+
+private:
+	uint8_t m_status = 0; // running status, 0 if data bytes are to be skipped
+	uint8_t m_data[2] = {};
+	int m_count = 0;
+	int m_expected = 2;
+};
+
+// The control number and value that a message is dispatched as. Mappings address controls by
+// number, so messages without one, such as pitch bends, return false.
+inline bool GetMidiControl(const MidiMessage& message, unsigned char& control, unsigned char& value)
+{
+	switch (message.type)
+	{
+	case MidiMessageType::ControlChange:
+	case MidiMessageType::NoteOn:
+		control = message.data1;
+		value = message.data2;
+		return true;
+	case MidiMessageType::NoteOff:
+		control = message.data1;
+		value = 0; // the release velocity doesn't matter to buttons
+		return true;
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,150 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "midi_trace.h"
+
+#include <string.h>
+
+static const char g_traceMagic[4] = { 'K', 'R', 'G', 'T' };
+static const uint32_t g_traceVersion = 1;
+
+// records are written from the MIDI event path, so keep the system calls rare
+#define TRACE_WRITE_BUFFER_SIZE (64 * 1024)
+
+bool MidiTraceWriter::Open(const std::string& fileName)
+{
+	Close();
+
+	m_file = fopen(fileName.c_str(), "wb");
+	if (!m_file)
+	{
+		fprintf(stderr, "error: couldn't create %s\n", fileName.c_str());
+		return false;
+	}
+
+	setvbuf(m_file, nullptr, _IOFBF, TRACE_WRITE_BUFFER_SIZE);
+
+	unsigned char header[8];
+	memcpy(header, g_traceMagic, 4);
+	for (int i = 0; i < 4; i++)
+		header[4 + i] = (unsigned char)(g_traceVersion >> (8 * i));
+
+	fwrite(header, sizeof(header), 1, m_file);
+	m_previousTime = -1;
+
+	return true;
+}
+
+void MidiTraceWriter::Close()
+{
+	if (!m_file)
+		return;
+
+	fclose(m_file);
+	m_file = nullptr;
+}
+
+void MidiTraceWriter::Write(int64_t time_us, unsigned char channel, unsigned char value, unsigned char device)
+{
+	if (m_previousTime < 0)
+		m_previousTime = time_us;
+
+	// a pause longer than the 32-bit delta allows (over an hour) is shortened,
+	// and a timestamp earlier than the previous one (e.g. from another reader) replays at once
+	int64_t delta = time_us - m_previousTime;
+	if (delta < 0)
+		delta = 0;
+	else if (delta > int64_t(UINT32_MAX))
+		delta = UINT32_MAX;
+	m_previousTime = time_us;
+
+	unsigned char record[8] = {
+		(unsigned char)delta,
+		(unsigned char)(delta >> 8),
+		(unsigned char)(delta >> 16),
+		(unsigned char)(delta >> 24),
+		channel,
+		value,
+		device,
+		0
+	};
+
+	fwrite(record, sizeof(record), 1, m_file);
+}
+
+bool MidiTraceReader::Open(const std::string& fileName)
+{
+	Close();
+
+	m_file = fopen(fileName.c_str(), "rb");
+	if (!m_file)
+	{
+		fprintf(stderr, "error: couldn't open %s\n", fileName.c_str());
+		return false;
+	}
+
+	unsigned char header[8];
+	if (fread(header, sizeof(header), 1, m_file) != 1 || memcmp(header, g_traceMagic, 4) != 0)
+	{
+		fprintf(stderr, "error: %s is not a korgi MIDI trace\n", fileName.c_str());
+		Close();
+		return false;
+	}
+
+	uint32_t version = header[4] | (header[5] << 8) | (header[6] << 16) | (uint32_t(header[7]) << 24);
+	if (version != g_traceVersion)
+	{
+		fprintf(stderr, "error: %s has unsupported trace version %u\n", fileName.c_str(), version);
+		Close();
+		return false;
+	}
+
+	m_time = 0;
+	return true;
+}
+
+void MidiTraceReader::Close()
+{
+	if (!m_file)
+		return;
+
+	fclose(m_file);
+	m_file = nullptr;
+}
+
+bool MidiTraceReader::Read(MidiTraceEvent& event)
+{
+	unsigned char record[8];
+	if (!m_file || fread(record, sizeof(record), 1, m_file) != 1)
+		return false;
+
+	m_time += record[0] | (record[1] << 8) | (record[2] << 16) | (int64_t(record[3]) << 24);
+
+	event.time_us = m_time;
+	event.channel = record[4];
+	event.value = record[5];
+	event.device = record[6];
+
+	return true;
+}
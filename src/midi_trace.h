@@ -0,0 +1,76 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+// Binary MIDI event trace. The file starts with the "KRGT" magic and a 32-bit version,
+// followed by 8-byte little-endian records:
+//   uint32 microseconds since the previous event
+//   uint8  channel
+//   uint8  value
+//   uint8  device index
+//   uint8  reserved, zero
+
+struct MidiTraceEvent
+{
+	int64_t time_us; // since the first event of the trace
+	unsigned char channel;
+	unsigned char value;
+	unsigned char device;
+};
+
+class MidiTraceWriter
+{
+public:
+	~MidiTraceWriter() { Close(); }
+
+	bool Open(const std::string& fileName);
+	void Close();
+	bool IsOpen() const { return m_file != nullptr; }
+
+	// 'time_us' is any monotonic time in microseconds
+	void Write(int64_t time_us, unsigned char channel, unsigned char value, unsigned char device);
+
+private:
+	FILE* m_file = nullptr;
+	int64_t m_previousTime = -1;
+};
+
+class MidiTraceReader
+{
+public:
+	~MidiTraceReader() { Close(); }
+
+	bool Open(const std::string& fileName);
+	void Close();
+
+	// Returns false at the end of the trace
+	bool Read(MidiTraceEvent& event);
+
+private:
+	FILE* m_file = nullptr;
+	int64_t m_time = 0;
+};
@@ -0,0 +1,197 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "output.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include "binary_protocol.h"
+
+using namespace std;
+
+static void Append(vector<char>& out, const void* data, size_t length)
+{
+	out.insert(out.end(), (const char*)data, (const char*)data + length);
+}
+
+// Q2PRO remote console commands joined with ';'
+class RconEncoder : public OutputEncoder
+{
+public:
+	RconEncoder()
+	{
+		separator = ";";
+		separator_length = 1;
+		terminator_length = 1;
+	}
+
+	void EncodeHeader(const string& password, vector<char>& out) const override
+	{
+		Append(out, "\xff\xff\xff\xffrcon ", 9);
+		Append(out, password.c_str(), password.size());
+		out.push_back(' ');
+	}
+
+	bool EncodeUpdate(const OutputUpdate& update, vector<char>& out) const override
+	{
+		Append(out, update.command, strlen(update.command));
+		return true;
+	}
+};
+
+// Packed records, see binary_protocol.h
+class BinaryEncoder : public OutputEncoder
+{
+public:
+	void EncodeHeader(const string& password, vector<char>& out) const override
+	{
+		BinaryHeader header = { BINARY_MAGIC, BINARY_VERSION, 0, GetBinaryToken(password.c_str()), 0 };
+		char encoded[sizeof(BinaryHeader)];
+		EncodeBinaryHeader(header, encoded);
+		Append(out, encoded, sizeof(encoded));
+	}
+
+	bool EncodeUpdate(const OutputUpdate& update, vector<char>& out) const override
+	{
+		BinaryRecord record = {};
+		record.control = uint16_t(update.control);
+		record.type = update.button ? BinaryRecordType::Button : BinaryRecordType::Knob;
+		record.value = update.value;
+
+		char encoded[sizeof(BinaryRecord)];
+		EncodeBinaryRecord(record, encoded);
+		Append(out, encoded, sizeof(encoded));
+		return true;
+	}
+
+	void Finish(char* datagram, int /*length*/, int count, uint32_t sequence) const override
+	{
+		StampBinaryHeader(datagram, uint16_t(count), sequence);
+	}
+};
+
+// Open Sound Control bundles, one message per update: knobs send their value as a float to the
+// address "/<variable>", buttons send their command as a string to "/command"
+class OscEncoder : public OutputEncoder
+{
+public:
+	void EncodeHeader(const string& /*password*/, vector<char>& out) const override
+	{
+		// the time tag is set when the bundle is sent
+		Append(out, "#bundle\0\0\0\0\0\0\0\0\0", 16);
+	}
+
+	bool EncodeUpdate(const OutputUpdate& update, vector<char>& out) const override
+	{
+		// bundle elements are prefixed with their size, which is known at the end
+		size_t start = out.size();
+		Append(out, "\0\0\0\0", 4);
+
+		string address = update.button ? "/command" : update.name;
+		if (address[0] != '/')
+			address = "/" + address;
+
+		AppendString(out, address.c_str());
+
+		if (update.button)
+		{
+			AppendString(out, ",s");
+			AppendString(out, update.name);
+		}
+		else
+		{
+			AppendString(out, ",f");
+			uint32_t bits;
+			memcpy(&bits, &update.value, sizeof(bits));
+			AppendBigEndian(out, bits);
+		}
+
+		uint32_t size = uint32_t(out.size() - start - 4);
+		for (int byte = 0; byte < 4; byte++)
+			out[start + byte] = char(size >> (24 - 8 * byte));
+
+		return true;
+	}
+
+	void Finish(char* datagram, int /*length*/, int /*count*/, uint32_t /*sequence*/) const override
+	{
+		// NTP time: seconds since 1900 and a 32-bit fraction
+		auto now = chrono::system_clock::now().time_since_epoch();
+		uint64_t seconds = uint64_t(chrono::duration_cast<chrono::seconds>(now).count());
+		uint64_t fraction = uint64_t(chrono::duration_cast<chrono::nanoseconds>(now).count() % 1000000000) * (1ull << 32) / 1000000000;
+		uint64_t timeTag = ((seconds + 2208988800ull) << 32) | fraction;
+
+		for (int byte = 0; byte < 8; byte++)
+			datagram[8 + byte] = char(timeTag >> (56 - 8 * byte));
+	}
+
+private:
+	// OSC strings are zero terminated and padded to a multiple of four bytes
+	static void AppendString(vector<char>& out, const char* text)
+	{
+		size_t length = strlen(text);
+		Append(out, text, length);
+		out.resize(out.size() + 4 - length % 4, 0);
+	}
+
+	static void AppendBigEndian(vector<char>& out, uint32_t value)
+	{
+		for (int byte = 0; byte < 4; byte++)
+			out.push_back(char(value >> (24 - 8 * byte)));
+	}
+};
+
+// One line of text per update, for the file and stdout outputs
+class TextEncoder : public OutputEncoder
+{
+public:
+	void EncodeHeader(const string& /*password*/, vector<char>& /*out*/) const override
+	{
+	}
+
+	bool EncodeUpdate(const OutputUpdate& update, vector<char>& out) const override
+	{
+		Append(out, update.command, strlen(update.command));
+		out.push_back('\n');
+		return true;
+	}
+};
+
+const OutputEncoder& GetOutputEncoder(OutputFormat format)
+{
+	static const RconEncoder rcon;
+	static const BinaryEncoder binary;
+	static const OscEncoder osc;
+	static const TextEncoder text;
+
+	switch (format)
+	{
+	case OutputFormat::Binary: return binary;
+	case OutputFormat::Osc: return osc;
+	case OutputFormat::Text: return text;
+	default: return rcon;
+	}
+}
@@ -0,0 +1,64 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+// What one packet carries, the input of OutputEncoder::EncodeUpdate
+struct OutputUpdate
+{
+	int control = 0;           // device * MIDI_CHANNEL_COUNT + MIDI channel
+	bool button = false;
+	const char* name = "";     // knob variable, or button command
+	float value = 0.f;         // scaled knob value, 1 for a button press
+	const char* command = "";  // console command, "<variable> <value>" for knobs
+};
+
+// Renders updates in the wire format of one kind of output. A datagram is a header followed by
+// one or more updates; the dispatcher pre-renders single updates at config load and joins
+// updates that are sent at the same time into batches, so the encoders only describe the layout.
+// Encoders are stateless and shared, per-target state such as sequence numbers lives in PacketSet.
+class OutputEncoder
+{
+public:
+	virtual ~OutputEncoder() {}
+
+	// Appends the start of every datagram
+	virtual void EncodeHeader(const std::string& password, std::vector<char>& out) const = 0;
+
+	// Appends one update, returns false if the format can't represent it
+	virtual bool EncodeUpdate(const OutputUpdate& update, std::vector<char>& out) const = 0;
+
+	// Completes a datagram of 'length' bytes that holds 'count' updates right before it is sent
+	virtual void Finish(char* /*datagram*/, int /*length*/, int /*count*/, uint32_t /*sequence*/) const {}
+
+	const char* separator = ""; // between two updates in a datagram
+	int separator_length = 0;
+	int terminator_length = 0;  // zero bytes after the last update
+};
+
+const OutputEncoder& GetOutputEncoder(OutputFormat format);
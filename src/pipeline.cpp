@@ -0,0 +1,166 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "pipeline.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+// Must be a power of two. MIDI is slow, the queue only has to absorb the sender falling behind.
+#define PIPELINE_QUEUE_SIZE 4096
+
+static SpscQueue<MidiInputRecord, PIPELINE_QUEUE_SIZE> g_inputQueue;
+
+// set while the sender is blocked, or about to block, in poll()
+static std::atomic<bool> g_senderSleeping(false);
+static int g_senderWakeFd = -1;
+
+bool OpenPipeline()
+{
+#ifdef _WIN32
+	fprintf(stderr, "error: the pipelined mode is not supported on Windows\n");
+	return false;
+#else
+	g_senderWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (g_senderWakeFd < 0)
+	{
+		fprintf(stderr, "error: failed to create an eventfd for the sender thread\n");
+		return false;
+	}
+
+	return true;
+#endif
+}
+
+void ClosePipeline()
+{
+#ifndef _WIN32
+	if (g_senderWakeFd >= 0)
+		close(g_senderWakeFd);
+	g_senderWakeFd = -1;
+#endif
+}
+
+bool PushMidiInput(const MidiInputRecord& record)
+{
+	return g_inputQueue.Push(record);
+}
+
+void WakeSender()
+{
+#ifndef _WIN32
+	// orders the records pushed before against the load of the flag, see BeginSenderSleep()
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (!g_senderSleeping.load(std::memory_order_relaxed))
+		return;
+
+	uint64_t one = 1;
+	if (write(g_senderWakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		fprintf(stderr, "\nwarning: failed to wake up the sender thread\n");
+#endif
+}
+
+bool PopMidiInput(MidiInputRecord& record)
+{
+	return g_inputQueue.Pop(record);
+}
+
+int GetSenderWakeFd()
+{
+	return g_senderWakeFd;
+}
+
+bool BeginSenderSleep()
+{
+	g_senderSleeping.store(true, std::memory_order_relaxed);
+
+	// either the reader sees the flag and wakes us up, or we see its records here
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (g_inputQueue.Empty())
+		return true;
+
+	g_senderSleeping.store(false, std::memory_order_relaxed);
+	return false;
+}
+
+void EndSenderSleep(bool woken)
+{
+	g_senderSleeping.store(false, std::memory_order_relaxed);
+
+#ifndef _WIN32
+	// resets the eventfd counter, however many wakeups were written
+	uint64_t count;
+	if (woken)
+		while (read(g_senderWakeFd, &count, sizeof(count)) < 0 && errno == EINTR)
+			;
+#endif
+}
+
+void SetThreadScheduling(const ThreadConfig& config, const char* name)
+{
+#ifdef _WIN32
+	if (config.priority > 0 && !SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+		fprintf(stderr, "warning: failed to raise the priority of the %s thread\n", name);
+
+	if (config.cpu >= 0 && !SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << config.cpu))
+		fprintf(stderr, "warning: failed to pin the %s thread to CPU %d\n", name, config.cpu);
+#else
+	if (config.priority > 0)
+	{
+		sched_param param = {};
+		param.sched_priority = config.priority;
+
+		int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (err)
+			fprintf(stderr, "warning: failed to set SCHED_FIFO priority %d for the %s thread: %s\n", config.priority, name, strerror(err));
+	}
+
+	if (config.cpu >= CPU_SETSIZE)
+	{
+		fprintf(stderr, "warning: can't pin the %s thread to CPU %d, the highest CPU index is %d\n", name, config.cpu, CPU_SETSIZE - 1);
+	}
+	else if (config.cpu >= 0)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(config.cpu, &cpus);
+
+		int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (err)
+			fprintf(stderr, "warning: failed to pin the %s thread to CPU %d: %s\n", name, config.cpu, strerror(err));
+	}
+#endif
+}
@@ -0,0 +1,116 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+#include "config.h"
+#include "dispatch.h"
+
+// Pipelined mode: a reader thread only dequeues MIDI events and pushes them into a queue,
+// and the main loop, which becomes the sender thread, dispatches and transmits them.
+
+// Ring buffer for one producer thread and one consumer thread. Push() and Pop() are wait-free:
+// each side owns one index and caches the last value it has seen of the other one, so the
+// shared cache lines are only touched when the cached value runs out.
+template <typename T, unsigned Size>
+class SpscQueue
+{
+	static_assert((Size & (Size - 1)) == 0, "the size must be a power of two");
+
+public:
+	// Returns false if the queue is full
+	bool Push(const T& item)
+	{
+		unsigned head = m_head.load(std::memory_order_relaxed);
+		if (head - m_cachedTail >= Size)
+		{
+			m_cachedTail = m_tail.load(std::memory_order_acquire);
+			if (head - m_cachedTail >= Size)
+				return false;
+		}
+
+		m_items[head & (Size - 1)] = item;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Returns false if the queue is empty
+	bool Pop(T& item)
+	{
+		unsigned tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_cachedHead)
+		{
+			m_cachedHead = m_head.load(std::memory_order_acquire);
+			if (tail == m_cachedHead)
+				return false;
+		}
+
+		item = m_items[tail & (Size - 1)];
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Only meaningful on the consumer side, the producer may add items at any time
+	bool Empty() const
+	{
+		return m_tail.load(std::memory_order_relaxed) == m_head.load(std::memory_order_acquire);
+	}
+
+private:
+	T m_items[Size];
+	alignas(64) std::atomic<unsigned> m_head = { 0 }; // next item to write, owned by the producer
+	unsigned m_cachedTail = 0;
+	alignas(64) std::atomic<unsigned> m_tail = { 0 }; // next item to read, owned by the consumer
+	unsigned m_cachedHead = 0;
+};
+
+// A MIDI event on its way from the reader thread to the sender thread
+struct MidiInputRecord
+{
+	Clock::time_point dequeued;
+	int64_t source_ns;   // timestamp of the MIDI driver, -1 if the event has none
+	unsigned char device; // index in KorgiConfig::devices
+	unsigned char channel;
+	unsigned char value;
+};
+
+bool OpenPipeline();
+void ClosePipeline();
+
+// Reader side. WakeSender() is called after a burst of pushes and only makes a system call
+// if the sender is sleeping.
+bool PushMidiInput(const MidiInputRecord& record);
+void WakeSender();
+
+// Sender side. Before sleeping in poll() on GetSenderWakeFd(), the sender calls BeginSenderSleep(),
+// which returns false if records have arrived in the meantime, and EndSenderSleep() afterwards.
+bool PopMidiInput(MidiInputRecord& record);
+int GetSenderWakeFd();
+bool BeginSenderSleep();
+void EndSenderSleep(bool woken);
+
+// Applies the real-time priority and CPU affinity of 'config' to the calling thread.
+// Failures, typically missing privileges, are reported as warnings.
+void SetThreadScheduling(const ThreadConfig& config, const char* name);
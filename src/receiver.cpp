@@ -0,0 +1,136 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+// korgi_receiver: reference decoder for the binary control protocol, prints every update it receives.
+// Usage: korgi_receiver [port] [password]
+
+#define _CRT_SECURE_NO_WARNINGS
+#define NOMINMAX
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <WinSock2.h>
+#pragma comment(lib, "ws2_32")
+#else
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "binary_protocol.h"
+
+int main(int argc, char** argv)
+{
+	int port = argc > 1 ? atoi(argv[1]) : 27910;
+	const char* password = argc > 2 ? argv[2] : "";
+	uint32_t token = GetBinaryToken(password);
+
+#ifdef _WIN32
+	WSADATA wsaData = {};
+	if (0 != WSAStartup(MAKEWORD(2, 2), &wsaData))
+	{
+		fprintf(stderr, "error: failed to initialize WinSock\n");
+		return 1;
+	}
+
+	SOCKET receiveSocket = socket(AF_INET, SOCK_DGRAM, 0);
+#else
+	int receiveSocket = socket(AF_INET, SOCK_DGRAM, 0);
+#endif
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(receiveSocket, (sockaddr*)&address, sizeof(address)))
+	{
+		fprintf(stderr, "error: failed to bind UDP port %d\n", port);
+		return 1;
+	}
+
+	printf("korgi_receiver: listening on UDP port %d\n", port);
+
+	bool first = true;
+	uint32_t expected = 0;
+	uint64_t datagrams = 0, lost = 0, rejected = 0;
+
+	for (;;)
+	{
+		char data[BINARY_MAX_DATAGRAM];
+		int length = int(recv(receiveSocket, data, sizeof(data), 0));
+		if (length < 0)
+			break;
+
+		BinaryHeader header;
+		const char* records = DecodeBinaryDatagram(data, length, token, header);
+		if (!records)
+		{
+			rejected++;
+			fprintf(stderr, "korgi_receiver: rejected a %d byte datagram, %llu so far\n", length, (unsigned long long)rejected);
+			continue;
+		}
+
+		// sequence numbers wrap around, so the difference tells a gap from a late datagram
+		int32_t gap = int32_t(header.sequence - expected);
+		if (!first && gap > 0)
+		{
+			lost += gap;
+			printf("korgi_receiver: %d datagrams missing before %u, %llu lost so far\n", gap, header.sequence, (unsigned long long)lost);
+		}
+		else if (!first && gap < 0)
+		{
+			printf("korgi_receiver: datagram %u arrived out of order\n", header.sequence);
+		}
+
+		if (first || gap >= 0)
+			expected = header.sequence + 1;
+		first = false;
+		datagrams++;
+
+		for (int index = 0; index < header.count; index++)
+		{
+			BinaryRecord record = DecodeBinaryRecord(records + index * sizeof(BinaryRecord));
+
+			int device = record.control / 128;
+			int channel = record.control % 128;
+
+			if (record.type == BinaryRecordType::Button)
+				printf("#%u device %d channel %d button\n", header.sequence, device, channel);
+			else
+				printf("#%u device %d channel %d knob %.3f\n", header.sequence, device, channel, record.value);
+		}
+
+		fflush(stdout);
+	}
+
+#ifdef _WIN32
+	closesocket(receiveSocket);
+	WSACleanup();
+#else
+	close(receiveSocket);
+#endif
+
+	return 0;
+}
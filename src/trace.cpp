@@ -0,0 +1,145 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static int HighestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return int(index);
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+void LatencyHistogram::Record(uint64_t ns)
+{
+	int index;
+	if (ns < SubBucketCount)
+	{
+		index = int(ns);
+	}
+	else
+	{
+		int shift = HighestBit(ns) - SubBucketBits;
+		index = SubBucketCount + shift * SubBucketCount + int(ns >> shift) - SubBucketCount;
+	}
+
+	m_buckets[index].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t max = m_max.load(std::memory_order_relaxed);
+	while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+		;
+}
+
+uint64_t LatencyHistogram::Count() const
+{
+	return m_count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Max() const
+{
+	return m_max.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Percentile(double percentile) const
+{
+	uint64_t count = Count();
+	if (!count)
+		return 0;
+
+	uint64_t rank = std::max<uint64_t>(1, uint64_t(percentile / 100.0 * double(count) + 0.5));
+	uint64_t seen = 0;
+
+	for (int index = 0; index < BucketCount; index++)
+	{
+		seen += m_buckets[index].load(std::memory_order_relaxed);
+		if (seen < rank)
+			continue;
+
+		// highest value that falls into the bucket
+		if (index < SubBucketCount)
+			return uint64_t(index);
+
+		int shift = (index - SubBucketCount) / SubBucketCount;
+		uint64_t sub = uint64_t(SubBucketCount + (index - SubBucketCount) % SubBucketCount);
+		return std::min(Max(), ((sub + 1) << shift) - 1);
+	}
+
+	return Max();
+}
+
+static LatencyHistogram g_histograms[int(TraceInterval::Count)];
+static std::atomic<int64_t> g_minSourceOffset(INT64_MAX);
+
+static const char* g_intervalNames[int(TraceInterval::Count)] = {
+	"input",
+	"dispatch",
+	"send",
+	"total",
+};
+
+void TraceRecord(TraceInterval interval, int64_t ns)
+{
+	g_histograms[int(interval)].Record(uint64_t(std::max<int64_t>(0, ns)));
+}
+
+void TraceSourceTime(int64_t sourceNs, int64_t dequeuedNs)
+{
+	int64_t offset = dequeuedNs - sourceNs;
+
+	int64_t minOffset = g_minSourceOffset.load(std::memory_order_relaxed);
+	while (offset < minOffset && !g_minSourceOffset.compare_exchange_weak(minOffset, offset, std::memory_order_relaxed))
+		;
+
+	TraceRecord(TraceInterval::Input, offset - std::min(offset, minOffset));
+}
+
+void PrintTraceReport()
+{
+	printf("\nkorgi: latency in microseconds\n");
+	printf("  %-10s %10s %10s %10s %10s %10s\n", "interval", "count", "p50", "p99", "p99.9", "max");
+
+	for (int interval = 0; interval < int(TraceInterval::Count); interval++)
+	{
+		const LatencyHistogram& histogram = g_histograms[interval];
+
+		printf("  %-10s %10llu %10.1f %10.1f %10.1f %10.1f\n", g_intervalNames[interval],
+			(unsigned long long)histogram.Count(),
+			double(histogram.Percentile(50.0)) / 1000.0,
+			double(histogram.Percentile(99.0)) / 1000.0,
+			double(histogram.Percentile(99.9)) / 1000.0,
+			double(histogram.Max()) / 1000.0);
+	}
+
+	fflush(stdout);
+}
@@ -0,0 +1,68 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Log-linear latency histogram in the spirit of HdrHistogram: values are grouped by
+// power of two and each power of two is split into 32 linear sub-buckets, so the
+// reported percentiles are within about 3% of the recorded values.
+// Recording is wait-free and may happen on any thread.
+class LatencyHistogram
+{
+public:
+	void Record(uint64_t ns);
+
+	uint64_t Count() const;
+	uint64_t Max() const;
+	uint64_t Percentile(double percentile) const;
+
+private:
+	static const int SubBucketBits = 5;
+	static const int SubBucketCount = 1 << SubBucketBits;
+	static const int BucketCount = SubBucketCount + (64 - SubBucketBits) * SubBucketCount;
+
+	std::atomic<uint64_t> m_buckets[BucketCount] = {};
+	std::atomic<uint64_t> m_count = { 0 };
+	std::atomic<uint64_t> m_max = { 0 };
+};
+
+// Intervals recorded for every traced MIDI event
+enum class TraceInterval
+{
+	Input,    // MIDI event timestamp to dequeue, relative to the fastest delivery seen
+	Dispatch, // dequeue to dispatch
+	Send,     // dispatch to the return of the system call that sent the event
+	Total,    // dequeue to sent
+	Count,
+};
+
+void TraceRecord(TraceInterval interval, int64_t ns);
+
+// Records the Input interval for an event that the MIDI driver stamped with 'sourceNs'.
+// The driver clock has an unknown origin, so the delay is measured relative to the
+// smallest difference between the two clocks seen so far.
+void TraceSourceTime(int64_t sourceNs, int64_t dequeuedNs);
+
+void PrintTraceReport();
@@ -0,0 +1,349 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#include "uring_sender.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <algorithm>
+
+#include "metrics.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define KORGI_IO_URING
+#endif
+#endif
+
+#ifdef KORGI_IO_URING
+
+// The ring indices are shared with the kernel, which reads the submission tail and writes the
+// completion tail concurrently
+static unsigned LoadAcquire(const unsigned* index)
+{
+	return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static void StoreRelease(unsigned* index, unsigned value)
+{
+	__atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+static int EnterRing(int ring, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+	return int(syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static bool SupportsZeroCopySend(int ring)
+{
+	const int opCount = IORING_OP_SEND_ZC + 1;
+	char buffer[sizeof(io_uring_probe) + opCount * sizeof(io_uring_probe_op)] = {};
+	io_uring_probe* probe = (io_uring_probe*)buffer;
+
+	if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_PROBE, probe, opCount) < 0)
+		return false;
+
+	return probe->last_op >= IORING_OP_SEND_ZC && (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED);
+}
+
+bool UringSender::Open(int socket, int bufferCount, int bufferSize)
+{
+	Close();
+
+	io_uring_params params = {};
+	m_ring = int(syscall(__NR_io_uring_setup, unsigned(bufferCount), &params));
+	if (m_ring < 0)
+	{
+		fprintf(stderr, "warning: io_uring is not available: %s\n", strerror(errno));
+		return false;
+	}
+
+	if (!SupportsZeroCopySend(m_ring))
+	{
+		fprintf(stderr, "warning: io_uring doesn't support zero-copy sends on this kernel\n");
+		Close();
+		return false;
+	}
+
+	m_socket = socket;
+
+	m_sqMappingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	m_cqMappingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		m_sqMappingSize = m_cqMappingSize = std::max(m_sqMappingSize, m_cqMappingSize);
+
+	m_sqMapping = mmap(nullptr, m_sqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+	if (m_sqMapping == MAP_FAILED)
+		m_sqMapping = nullptr;
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		m_cqMapping = m_sqMapping;
+	}
+	else
+	{
+		m_cqMapping = mmap(nullptr, m_cqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+		if (m_cqMapping == MAP_FAILED)
+			m_cqMapping = nullptr;
+	}
+
+	m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+	m_sqes = sqes == MAP_FAILED ? nullptr : (io_uring_sqe*)sqes;
+
+	if (!m_sqMapping || !m_cqMapping || !m_sqes)
+	{
+		fprintf(stderr, "warning: failed to map the io_uring rings: %s\n", strerror(errno));
+		Close();
+		return false;
+	}
+
+	char* sq = (char*)m_sqMapping;
+	m_sqTail = (unsigned*)(sq + params.sq_off.tail);
+	m_sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+	m_sqArray = (unsigned*)(sq + params.sq_off.array);
+	m_sqEntries = params.sq_entries;
+
+	char* cq = (char*)m_cqMapping;
+	m_cqHead = (unsigned*)(cq + params.cq_off.head);
+	m_cqTail = (unsigned*)(cq + params.cq_off.tail);
+	m_cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+	m_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	// the pool is pinned once here instead of on every send
+	m_bufferSize = bufferSize;
+	m_buffersSize = size_t(bufferCount) * bufferSize;
+	void* buffers = mmap(nullptr, m_buffersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	m_buffers = buffers == MAP_FAILED ? nullptr : (char*)buffers;
+
+	iovec pool = { m_buffers, m_buffersSize };
+	if (!m_buffers || syscall(__NR_io_uring_register, m_ring, IORING_REGISTER_BUFFERS, &pool, 1) < 0)
+	{
+		fprintf(stderr, "warning: failed to register the io_uring buffers: %s\n", strerror(errno));
+		Close();
+		return false;
+	}
+
+	m_bufferRefs = new int[bufferCount]();
+	m_freeBuffers = new int[bufferCount];
+	for (int buffer = 0; buffer < bufferCount; buffer++)
+		m_freeBuffers[buffer] = bufferCount - 1 - buffer;
+	m_freeCount = bufferCount;
+
+	return true;
+}
+
+void UringSender::Close()
+{
+	if (m_ring >= 0 && m_freeBuffers)
+	{
+		Submit();
+		while (m_inFlight && WaitForCompletion())
+			;
+	}
+
+	if (m_buffers)
+		munmap(m_buffers, m_buffersSize);
+	if (m_sqes)
+		munmap(m_sqes, m_sqesSize);
+	if (m_cqMapping && m_cqMapping != m_sqMapping)
+		munmap(m_cqMapping, m_cqMappingSize);
+	if (m_sqMapping)
+		munmap(m_sqMapping, m_sqMappingSize);
+	if (m_ring >= 0)
+		close(m_ring);
+
+	delete[] m_bufferRefs;
+	delete[] m_freeBuffers;
+
+	m_buffers = nullptr;
+	m_sqes = nullptr;
+	m_cqMapping = nullptr;
+	m_sqMapping = nullptr;
+	m_ring = -1;
+	m_bufferRefs = nullptr;
+	m_freeBuffers = nullptr;
+	m_freeCount = 0;
+	m_queued = 0;
+	m_inFlight = 0;
+}
+
+void UringSender::Send(const char* payload, int length, const sockaddr_in* targets, int targetCount)
+{
+	if (targetCount <= 0 || length > m_bufferSize)
+		return;
+
+	while (!m_freeCount)
+	{
+		if (!WaitForCompletion())
+			return;
+	}
+
+	int buffer = m_freeBuffers[--m_freeCount];
+	char* data = m_buffers + size_t(buffer) * m_bufferSize;
+	memcpy(data, payload, length);
+
+	for (int target = 0; target < targetCount; target++)
+	{
+		// every send may post two completions, so limiting the sends to the size of the submission
+		// ring keeps the completion ring, which is twice as large, from overflowing
+		while (m_queued + m_inFlight >= m_sqEntries)
+		{
+			if (!WaitForCompletion())
+				break;
+		}
+
+		if (m_queued + m_inFlight >= m_sqEntries)
+			break;
+
+		unsigned tail = *m_sqTail;
+		unsigned index = tail & m_sqMask;
+		io_uring_sqe* sqe = &m_sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_SEND_ZC;
+		sqe->fd = m_socket;
+		sqe->addr = uint64_t(uintptr_t(data));
+		sqe->len = unsigned(length);
+		sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+		sqe->buf_index = 0;
+		sqe->addr2 = uint64_t(uintptr_t(&targets[target]));
+		sqe->addr_len = sizeof(sockaddr_in);
+		sqe->user_data = uint64_t(buffer);
+
+		m_sqArray[index] = index;
+		StoreRelease(m_sqTail, tail + 1);
+
+		m_bufferRefs[buffer]++;
+		m_queued++;
+	}
+
+	if (!m_bufferRefs[buffer])
+		m_freeBuffers[m_freeCount++] = buffer;
+}
+
+void UringSender::Submit()
+{
+	while (m_queued)
+	{
+		int submitted = EnterRing(m_ring, m_queued, 0, 0);
+		if (submitted < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			// completions have to be reaped before anything else can be submitted
+			if ((errno == EBUSY || errno == EAGAIN) && WaitForCompletion())
+				continue;
+
+			fprintf(stderr, "\nwarning: io_uring submission failed: %s\n", strerror(errno));
+			break;
+		}
+
+		m_queued -= unsigned(submitted);
+		m_inFlight += unsigned(submitted);
+	}
+
+	Reap();
+}
+
+void UringSender::Release(int buffer)
+{
+	m_inFlight--;
+	if (!--m_bufferRefs[buffer])
+		m_freeBuffers[m_freeCount++] = buffer;
+}
+
+void UringSender::Reap()
+{
+	unsigned head = *m_cqHead;
+	unsigned tail = LoadAcquire(m_cqTail);
+
+	for (; head != tail; head++)
+	{
+		const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+		int buffer = int(cqe.user_data);
+
+		// a zero-copy send completes with its result, followed by a notification once
+		// the kernel is done with the buffer, unless the result already says there is none
+		if (cqe.flags & IORING_CQE_F_NOTIF)
+		{
+			Release(buffer);
+			continue;
+		}
+
+		if (cqe.res < 0)
+			CountMetric(Metric::SendErrors);
+		else
+		{
+			CountMetric(Metric::PacketsSent);
+			CountMetric(Metric::BytesSent, uint64_t(cqe.res));
+		}
+
+		if (!(cqe.flags & IORING_CQE_F_MORE))
+			Release(buffer);
+	}
+
+	StoreRelease(m_cqHead, head);
+}
+
+bool UringSender::WaitForCompletion()
+{
+	int submitted = EnterRing(m_ring, m_queued, 1, IORING_ENTER_GETEVENTS);
+	if (submitted < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+	{
+		fprintf(stderr, "\nwarning: waiting for io_uring completions failed: %s\n", strerror(errno));
+		return false;
+	}
+
+	if (submitted > 0)
+	{
+		m_queued -= unsigned(submitted);
+		m_inFlight += unsigned(submitted);
+	}
+
+	Reap();
+	return true;
+}
+
+#else
+
+bool UringSender::Open(int socket, int bufferCount, int bufferSize)
+{
+	fprintf(stderr, "warning: korgi was built without io_uring support\n");
+	return false;
+}
+
+void UringSender::Close() {}
+void UringSender::Send(const char* payload, int length, const sockaddr_in* targets, int targetCount) {}
+void UringSender::Submit() {}
+
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+/*
+* Copyright (c) 2019, NVIDIA CORPORATION. All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining a
+* copy of this software and associated documentation files (the "Software"),
+* to deal in the Software without restriction, including without limitation
+* the rights to use, copy, modify, merge, publish, distribute, sublicense,
+* and/or sell copies of the Software, and to permit persons to whom the
+* Software is furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+* THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+* DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+// Sends UDP datagrams through io_uring. Payloads are copied into a pool of buffers that is
+// registered with the kernel once, queued as zero-copy sends to any number of targets and
+// submitted in batches. Completions are reaped later, so sending never waits for the network stack.
+// Requires Linux 6.0; Open() fails on older kernels and where io_uring is disabled.
+class UringSender
+{
+public:
+	~UringSender() { Close(); }
+
+	bool Open(int socket, int bufferCount, int bufferSize);
+
+	// Waits for the sends in flight, which still use the buffers
+	void Close();
+
+	bool IsOpen() const { return m_ring >= 0; }
+
+	// Queues 'payload' for each of the targets. The kernel copies the addresses during Submit().
+	void Send(const char* payload, int length, const sockaddr_in* targets, int targetCount);
+
+	// Submits everything queued since the last call with one system call
+	void Submit();
+
+private:
+	void Reap();
+	bool WaitForCompletion(); // returns false if the ring has failed
+	void Release(int buffer);
+
+	int m_ring = -1;
+	int m_socket = -1;
+
+	// mappings of the submission and completion rings, which may be the same
+	void* m_sqMapping = nullptr;
+	size_t m_sqMappingSize = 0;
+	void* m_cqMapping = nullptr;
+	size_t m_cqMappingSize = 0;
+	struct io_uring_sqe* m_sqes = nullptr;
+	size_t m_sqesSize = 0;
+
+	unsigned* m_sqTail = nullptr;
+	unsigned m_sqMask = 0;
+	unsigned* m_sqArray = nullptr;
+	unsigned m_sqEntries = 0;
+	unsigned* m_cqHead = nullptr;
+	unsigned* m_cqTail = nullptr;
+	unsigned m_cqMask = 0;
+	struct io_uring_cqe* m_cqes = nullptr;
+
+	// the registered pool, with the number of unfinished sends and a free list of its buffers
+	char* m_buffers = nullptr;
+	size_t m_buffersSize = 0;
+	int m_bufferSize = 0;
+	int* m_bufferRefs = nullptr;
+	int* m_freeBuffers = nullptr;
+	int m_freeCount = 0;
+
+	unsigned m_queued = 0;   // sends that haven't been submitted yet
+	unsigned m_inFlight = 0; // submitted sends whose buffers are still in use
+};
+
+#endif